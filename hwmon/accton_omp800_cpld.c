@@ -19,7 +19,18 @@
 #include <linux/module.h>
 #include <linux/i2c.h>
 #include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
 #include <linux/list.h>
+#include <linux/kref.h>
+#include <linux/rcupdate.h>
+#include <linux/regmap.h>
+#include <linux/workqueue.h>
+#include <linux/notifier.h>
+#include <linux/thermal.h>
+#include <linux/string.h>
+#include <linux/ktime.h>
+#include <linux/delay.h>
 #include <linux/dmi.h>
 #include <linux/hwmon.h>
 #include <linux/hwmon-sysfs.h>
@@ -33,12 +44,30 @@
 	#define DEBUG_PRINT(fmt, args...)
 #endif
 
-static LIST_HEAD(cpld_client_list);
-static struct mutex	 list_lock;
-
 #define OMP800_CPLD1_I2C_SLAVE_ADDR	0x60
 #define OMP800_CPLD2_I2C_SLAVE_ADDR 0x62
 
+/* CPLD clients are looked up by slave address, the exported accessors
+ * only need to serve the 0x60 ~ 0x67 range.
+ */
+#define OMP800_CPLD_ADDR_BASE		0x60
+#define OMP800_CPLD_ADDR_NUM		8
+
+#define OMP800_CPLD_BLOCK_MAX		I2C_SMBUS_BLOCK_MAX
+#define OMP800_CPLD_MAX_REGISTER	0xFF
+
+/* Control registers written by the host only, a write-back shadow of them
+ * lets omp800_cpld_update_bits() skip the read of a read-modify-write.
+ */
+static const u8 shadow_regs[] = {
+0x08, /* CPU/MAC reset */
+0x41, /* RELEASE/DIAG LED */
+0x42, /* FAN/PSU LED */
+0x43, /* SYSTEM LED */
+0x44, /* SYSTEM LED */
+0x45  /* SYSTEM LED */
+};
+
 enum sysfs_cpld_attributes {
 	VERSION,
 	CPU_ID,
@@ -50,7 +79,18 @@ enum sysfs_cpld_attributes {
 	RESET_CPU_A,
 	RESET_CPU_B,
 	RESET_MAC_A,
-	RESET_MAC_B
+	RESET_MAC_B,
+	TEMP_FEED_INTERVAL,
+	TEMP_FEED_CPU_ZONE,
+	TEMP_FEED_ERRORS,
+	CHASSIS_INVENTORY,
+	INVENTORY_INTERVAL,
+	CHASSIS_RESET,
+	CHASSIS_RESET_PULSE,
+	PRESENT_STATUS,
+	POLL_INTERVAL,
+	OWNER_STATE,
+	OWNER_INTERVAL
 };
 
 enum omp800_card_type {
@@ -59,23 +99,218 @@ enum omp800_card_type {
 	CT_UNKNOWN
 };
 
+struct cpld_client_node {
+	struct i2c_client *client;		/* NULL once the client is removed */
+	struct regmap	  *regmap;
+	struct mutex	   access_lock;	/* Serialize transactions on this CPLD */
+	struct kref		   kref;
+	unsigned long	   shadow_valid;	/* bit n != 0 if shadow[n] is valid */
+	u8				   shadow[ARRAY_SIZE(shadow_regs)];
+
+	/* Asynchronous requests, drained in order by queue_work */
+	spinlock_t		   queue_lock;
+	struct list_head   queue;
+	struct work_struct queue_work;
+	char			   queue_dead;	/* != 0 once no more requests are accepted */
+};
+
+enum cpld_async_type {
+	CPLD_ASYNC_READ,
+	CPLD_ASYNC_WRITE,
+	CPLD_ASYNC_UPDATE_BITS
+};
+
+struct cpld_async_req {
+	struct list_head list;
+	u8	 type;
+	u8	 reg;
+	u8	 mask;
+	u8	 value;		/* Value to write, value read on completion */
+	void (*complete)(void *context, int status, u8 value);
+	void *context;
+};
+
+/* Status registers sampled by the per-CPLD poller, a change of any bit in
+ * mask wakes up poll()/select() on the named attribute.
+ */
+#define CPLD_POLL_MAX_REGS			2
+#define CPLD_POLL_DEFAULT_INTERVAL	1000 /* ms */
+
+struct cpld_notify_attr {
+	u8			reg;
+	u8			mask;
+	const char *name;
+};
+
+struct cpld_poll_desc {
+	const u8					  *regs;
+	int							   num_regs;
+	const struct cpld_notify_attr *attrs;
+	int							   num_attrs;
+	unsigned int				   interval;	/* Default interval in ms */
+};
+
+static const u8 cpld1_poll_regs[] = { 0x48 };	/* Board presence */
+static const u8 cpld_remote_poll_regs[] = { 0x8 };	/* CPU/MAC reset */
+
+static const struct cpld_notify_attr cpld1_notify_attrs[] = {
+	{ 0x48, 0xFF, "present_status" },
+};
+
+static const struct cpld_notify_attr cpld_remote_notify_attrs[] = {
+	{ 0x8, 0x01, "reset_cpu_a" },
+	{ 0x8, 0x10, "reset_cpu_b" },
+	{ 0x8, 0x02, "reset_mac_a" },
+	{ 0x8, 0x20, "reset_mac_b" },
+};
+
+/* The inventory worker already tracks remote reset state on the fabric
+ * card, so the remote poller is only started on demand.
+ */
+static const struct cpld_poll_desc cpld1_poll = {
+	.regs	   = cpld1_poll_regs,
+	.num_regs  = ARRAY_SIZE(cpld1_poll_regs),
+	.attrs	   = cpld1_notify_attrs,
+	.num_attrs = ARRAY_SIZE(cpld1_notify_attrs),
+	.interval  = CPLD_POLL_DEFAULT_INTERVAL,
+};
+
+static const struct cpld_poll_desc cpld_remote_poll = {
+	.regs	   = cpld_remote_poll_regs,
+	.num_regs  = ARRAY_SIZE(cpld_remote_poll_regs),
+	.attrs	   = cpld_remote_notify_attrs,
+	.num_attrs = ARRAY_SIZE(cpld_remote_notify_attrs),
+	.interval  = 0,
+};
+
+struct cpld_regs_window;
+
 struct omp800_cpld_data {
 	u8 driver_type;
+	struct cpld_client_node *node;
 	struct device *hwmon_dev;
 	struct mutex   update_lock;
 	char			 valid;		   /* != 0 if registers are valid */
 	unsigned long	 last_updated;	/* In jiffies */
 	s8 temp_input[2];
+	struct delayed_work temp_feed_work;		/* Push CPU/MAC temp to 0x30/0x31 */
+	unsigned int	 temp_feed_interval;	/* In ms, 0 = disabled */
+	char			 temp_feed_zone[THERMAL_NAME_LENGTH]; /* CPU thermal zone */
+	u8				 temp_fed_valid;		/* bit n != 0 if temp_fed[n] is valid */
+	s8				 temp_fed[2];			/* Last temperature written by feeder */
+	unsigned int	 temp_feed_errors;		/* Failed writes to 0x30/0x31 */
+	const struct cpld_poll_desc *poll;		/* NULL if nothing to sample */
+	struct delayed_work poll_work;
+	unsigned int	 poll_interval;			/* In ms, 0 = disabled */
+	u8				 poll_valid;			/* != 0 if poll_val is valid */
+	u8				 poll_val[CPLD_POLL_MAX_REGS];
+	const struct cpld_regs_window *regs_window;	/* Map of the "regs" attribute */
 	u8 version;
     u8 slot_id;
 };
 
-struct cpld_client_node {
-	struct i2c_client *client;
-	struct list_head   list;
+static enum omp800_card_type card_type = CT_UNKNOWN;
+
+/* MAC temperature is not visible to the host kernel by itself, the switch
+ * SDK or MAC driver may register a callback returning it in millidegree C.
+ */
+struct mac_temp_provider {
+	int  (*get_temp)(void *priv, int *temp);
+	void  *priv;
 };
 
-static enum omp800_card_type card_type = CT_UNKNOWN;
+static struct mac_temp_provider mac_temp_provider;
+static DEFINE_MUTEX(mac_temp_lock);
+
+#define TEMP_FEED_DEFAULT_CPU_ZONE	"x86_pkg_temp"
+
+/* Chassis inventory kept by the fabric card, one entry per remote CPLD.
+ * Registers 0x1 (version) ~ 0x8 (reset) of each remote CPLD are fetched
+ * with one block read per refresh.
+ */
+#define INVENTORY_DEFAULT_INTERVAL	1000 /* ms */
+#define INVENTORY_REG_BEGIN			0x1
+#define INVENTORY_REG_NUM			8
+
+struct slot_inventory {
+	u8				registered;	/* != 0 if the remote CPLD is instantiated */
+	u8				present;	/* != 0 if the last refresh succeeded */
+	u8				version;
+	u8				slot_id;
+	u8				reset;
+	unsigned long	last_seen;	/* In jiffies, 0 if never seen */
+};
+
+static struct chassis_inventory {
+	struct mutex		  lock;
+	struct delayed_work	  work;
+	unsigned int		  interval;	/* In ms, 0 = disabled */
+	struct slot_inventory slot[OMP800_CPLD_ADDR_NUM];
+} inventory;
+
+/* Chassis-level reset of several remote CPLDs at once, the component mask
+ * uses the reg 0x8 bit layout (CPU-A:0x1, MAC-A:0x2, CPU-B:0x10, MAC-B:0x20).
+ */
+#define CHASSIS_RESET_COMPONENT_MASK	0x33
+#define CHASSIS_RESET_DEFAULT_PULSE		100	 /* ms */
+#define CHASSIS_RESET_MAX_PULSE			10000 /* ms */
+
+static struct chassis_reset {
+	struct mutex lock;			/* Serialize chassis reset operations */
+	unsigned int pulse;			/* Reset pulse width in ms */
+	u8			 slot_mask;		/* Last operation */
+	u8			 component_mask;
+	u8			 failed_mask;	/* Slots which failed to assert or release */
+	s64			 assert_us;
+	s64			 hold_us;
+	s64			 release_us;
+} chassis_reset;
+
+/* Active/standby ownership of the chassis fan/PDU control by the two CPUs
+ * of the fabric card, tracked with a heartbeat in OWNERSHIP_HEARTBEAT_REG
+ * (bit 7: CPU id, bit 6: claim, bit 0 ~ 5: counter). The owner writes a
+ * claim every interval, the standby CPU takes over once
+ * OWNERSHIP_MISSED_BEATS beats are missed, i.e. the owner hung or crashed,
+ * or as soon as the owner is held in reset. CPU-A starts on standby and
+ * writes a request every interval, the owner then steps down and writes a
+ * beat without claim, so the two CPUs never drive the fans at once.
+ *
+ * 0x50 is not in the cpld1 register description (0x1 ~ 0x2 id, 0x8 reset,
+ * 0x30 ~ 0x31 thermal, 0x41 ~ 0x45 LED, 0x48 presence). It is only used
+ * once a beat written to it reads back, otherwise, or with
+ * ownership_heartbeat=0, CPU-A owns the control and CPU-B only stands in
+ * while CPU-A is held in reset.
+ */
+#define OWNERSHIP_HEARTBEAT_REG		0x50
+#define OWNERSHIP_BEAT_CPU_B		0x80
+#define OWNERSHIP_BEAT_CLAIM		0x40
+#define OWNERSHIP_BEAT_COUNT_MASK	0x3F
+#define OWNERSHIP_DEFAULT_INTERVAL	500	/* ms */
+#define OWNERSHIP_MISSED_BEATS		4
+
+static bool ownership_heartbeat = true;
+module_param(ownership_heartbeat, bool, S_IRUGO);
+MODULE_PARM_DESC(ownership_heartbeat, "Exchange a fan/PDU ownership heartbeat through cpld1 register 0x50 (default on)");
+
+enum omp800_owner_state {
+	OWNER_NONE,		/* Not running, i.e. not on the fabric card */
+	OWNER_STANDBY,
+	OWNER_ACTIVE
+};
+
+static struct chassis_ownership {
+	struct mutex		lock;
+	struct delayed_work work;
+	struct blocking_notifier_head notifier;	/* Called with the new state */
+	struct cpld_client_node *node;	/* cpld1, referenced while running */
+	unsigned int		interval;	/* In ms */
+	u8					cpu_id;		/* 0:CPU-A, 1:CPU-B */
+	u8					state;		/* enum omp800_owner_state */
+	u8					beat;		/* Last heartbeat written or seen */
+	u8					missed;		/* Consecutive beats missed by the owner */
+	unsigned int		takeovers;
+	u8					heartbeat;	/* != 0 if the heartbeat register works */
+} ownership;
 
 u8 temp_regs[] = {
 0x30, /* CPU thermal */
@@ -87,242 +322,1571 @@ static int omp800_is_linecard(u8 cpld_val)
 	return (cpld_val & 0x10) ? 0 : 1;
 }
 
-static void omp800_cpld_add_client(struct i2c_client *client)
+/* Address-indexed registry of the local CPLD clients, and of the remote
+ * (line/fabric card) CPLD clients that share the same address range on the
+ * fabric card. Lookups are lockless (RCU + kref), registry_lock only
+ * serializes add/remove.
+ */
+static struct cpld_client_node __rcu *cpld_clients[OMP800_CPLD_ADDR_NUM];
+static struct cpld_client_node __rcu *remote_cpld_clients[OMP800_CPLD_ADDR_NUM];
+static DEFINE_MUTEX(registry_lock);
+
+/* Local cpld1, its presence register (0x48) is shared with other drivers */
+static struct omp800_cpld_data *cpld1_data;
+static DEFINE_MUTEX(cpld1_lock);
+
+/* Only the version (0x1) and slot/card id (0x2) registers are static and
+ * may be served from the register cache. Everything else, e.g. reset (0x8),
+ * CPU/MAC thermal (0x30/0x31), LED (0x41 ~ 0x45) and presence (0x48), is
+ * owned by the hardware and must always be read from the bus.
+ */
+static const struct regmap_range omp800_cpld_static_ranges[] = {
+	regmap_reg_range(0x1, 0x2),
+};
+
+static const struct regmap_access_table omp800_cpld_volatile_table = {
+	.no_ranges	 = omp800_cpld_static_ranges,
+	.n_no_ranges = ARRAY_SIZE(omp800_cpld_static_ranges),
+};
+
+static const struct regmap_config omp800_cpld_regmap_config = {
+	.reg_bits		= 8,
+	.val_bits		= 8,
+	.max_register	= OMP800_CPLD_MAX_REGISTER,
+	.volatile_table = &omp800_cpld_volatile_table,
+	.cache_type		= REGCACHE_RBTREE,
+};
+
+/* A remote CPLD belongs to a hot-pluggable card, even its version and
+ * slot id registers may change under us, so nothing is cached.
+ */
+static const struct regmap_config omp800_cpld_remote_regmap_config = {
+	.reg_bits		= 8,
+	.val_bits		= 8,
+	.max_register	= OMP800_CPLD_MAX_REGISTER,
+	.cache_type		= REGCACHE_NONE,
+};
+
+/* Register map behind the binary "regs" attribute, file offset n is
+ * register n. Registers outside the readable map read back as 0xFF,
+ * writes are refused unless every register is in the writable map.
+ * Each readable range is fetched with block reads; cached and volatile
+ * registers must not share a range, regmap would split the read up.
+ */
+struct cpld_regs_window {
+	struct regmap_access_table rd_table;
+	struct regmap_access_table wr_table;
+};
+
+static const struct regmap_range cpld1_rd_ranges[] = {
+	regmap_reg_range(0x1, 0x2),		/* Version, card/slot id */
+	regmap_reg_range(0x8, 0x8),		/* Reset */
+	regmap_reg_range(0x30, 0x31),	/* CPU/MAC temperature */
+	regmap_reg_range(0x41, 0x45),	/* LED */
+	regmap_reg_range(0x48, 0x48),	/* Presence */
+};
+
+static const struct regmap_range cpld1_wr_ranges[] = {
+	regmap_reg_range(0x8, 0x8),
+	regmap_reg_range(0x30, 0x31),
+	regmap_reg_range(0x41, 0x45),
+};
+
+static const struct regmap_range cpld2_rd_ranges[] = {
+	regmap_reg_range(0x1, 0x1),		/* Version */
+	regmap_reg_range(0x30, 0x31),	/* SFP presence */
+};
+
+static const struct regmap_range cpld_remote_rd_ranges[] = {
+	regmap_reg_range(0x1, 0x2),		/* Version, card/slot id */
+	regmap_reg_range(0x8, 0x8),		/* Reset */
+};
+
+static const struct regmap_range cpld_remote_wr_ranges[] = {
+	regmap_reg_range(0x8, 0x8),
+};
+
+static const struct cpld_regs_window cpld1_regs_window = {
+	.rd_table = { .yes_ranges = cpld1_rd_ranges, .n_yes_ranges = ARRAY_SIZE(cpld1_rd_ranges) },
+	.wr_table = { .yes_ranges = cpld1_wr_ranges, .n_yes_ranges = ARRAY_SIZE(cpld1_wr_ranges) },
+};
+
+static const struct cpld_regs_window cpld2_regs_window = {
+	.rd_table = { .yes_ranges = cpld2_rd_ranges, .n_yes_ranges = ARRAY_SIZE(cpld2_rd_ranges) },
+};
+
+static const struct cpld_regs_window cpld_remote_regs_window = {
+	.rd_table = { .yes_ranges = cpld_remote_rd_ranges, .n_yes_ranges = ARRAY_SIZE(cpld_remote_rd_ranges) },
+	.wr_table = { .yes_ranges = cpld_remote_wr_ranges, .n_yes_ranges = ARRAY_SIZE(cpld_remote_wr_ranges) },
+};
+
+static bool omp800_cpld_reg_in_table(const struct regmap_access_table *table, unsigned int reg)
+{
+	return regmap_reg_in_ranges(reg, table->yes_ranges, table->n_yes_ranges);
+}
+
+static void omp800_cpld_queue_work(struct work_struct *work);
+
+static struct cpld_client_node *omp800_cpld_alloc_node(struct i2c_client *client,
+														 const struct regmap_config *config)
 {
 	struct cpld_client_node *node = kzalloc(sizeof(struct cpld_client_node), GFP_KERNEL);
-	
+
 	if (!node) {
-		dev_dbg(&client->dev, "Can't allocate cpld_client_node (0x%x)\n", client->addr);
-		return;
+		return ERR_PTR(-ENOMEM);
 	}
-	
+
+	node->regmap = regmap_init_i2c(client, config);
+	if (IS_ERR(node->regmap)) {
+		int status = PTR_ERR(node->regmap);
+
+		kfree(node);
+		return ERR_PTR(status);
+	}
+
 	node->client = client;
-	
-	mutex_lock(&list_lock);
-	list_add(&node->list, &cpld_client_list);
-	mutex_unlock(&list_lock);
+	mutex_init(&node->access_lock);
+	kref_init(&node->kref);
+	spin_lock_init(&node->queue_lock);
+	INIT_LIST_HEAD(&node->queue);
+	INIT_WORK(&node->queue_work, omp800_cpld_queue_work);
+
+	return node;
+}
+
+static void omp800_cpld_release_node(struct kref *kref)
+{
+	/* The last reference may be dropped from atomic context, the regmap
+	 * is released by omp800_cpld_remove_client().
+	 */
+	kfree(container_of(kref, struct cpld_client_node, kref));
+}
+
+static struct cpld_client_node *__omp800_cpld_get_node(struct cpld_client_node __rcu **table,
+														unsigned short cpld_addr)
+{
+	struct cpld_client_node *node;
+	unsigned int index = cpld_addr - OMP800_CPLD_ADDR_BASE;
+
+	if (index >= OMP800_CPLD_ADDR_NUM) {
+		return NULL;
+	}
+
+	rcu_read_lock();
+	node = rcu_dereference(table[index]);
+	if (node && !kref_get_unless_zero(&node->kref)) {
+		node = NULL;
+	}
+	rcu_read_unlock();
+
+	return node;
+}
+
+static struct cpld_client_node *omp800_cpld_get_node(unsigned short cpld_addr)
+{
+	return __omp800_cpld_get_node(cpld_clients, cpld_addr);
+}
+
+static void omp800_cpld_put_node(struct cpld_client_node *node)
+{
+	kref_put(&node->kref, omp800_cpld_release_node);
+}
+
+static void omp800_cpld_add_client(struct cpld_client_node __rcu **table,
+								   struct cpld_client_node *node)
+{
+	unsigned int index = node->client->addr - OMP800_CPLD_ADDR_BASE;
+
+	if (index >= OMP800_CPLD_ADDR_NUM) {
+		dev_dbg(&node->client->dev, "Address out of cpld registry range (0x%x)\n", node->client->addr);
+		return;
+	}
+
+	mutex_lock(&registry_lock);
+
+	if (rcu_access_pointer(table[index])) {
+		dev_dbg(&node->client->dev, "Address already registered (0x%x)\n", node->client->addr);
+	}
+	else {
+		rcu_assign_pointer(table[index], node);
+	}
+
+	mutex_unlock(&registry_lock);
 }
 
-static void omp800_cpld_remove_client(struct i2c_client *client)
+/* Unregister a node and drop the reference taken at allocation, also used
+ * to unwind a node that was never added. Process context only.
+ */
+static void omp800_cpld_remove_client(struct cpld_client_node __rcu **table,
+									  struct cpld_client_node *node)
 {
-	struct list_head		*list_node = NULL;
-	struct cpld_client_node *cpld_node = NULL;
+	unsigned int index = node->client->addr - OMP800_CPLD_ADDR_BASE;
 	int found = 0;
-	
-	mutex_lock(&list_lock);
 
-	list_for_each(list_node, &cpld_client_list)
-	{
-		cpld_node = list_entry(list_node, struct cpld_client_node, list);
-		
-		if (cpld_node->client == client) {
-			found = 1;
-			break;
-		}
+	mutex_lock(&registry_lock);
+
+	if (index < OMP800_CPLD_ADDR_NUM &&
+		rcu_access_pointer(table[index]) == node) {
+		RCU_INIT_POINTER(table[index], NULL);
+		found = 1;
 	}
-	
+
+	mutex_unlock(&registry_lock);
+
 	if (found) {
-		list_del(list_node);
-		kfree(cpld_node);
+		synchronize_rcu();
 	}
-	
-	mutex_unlock(&list_lock);
+
+	/* Stop accepting asynchronous requests and complete the queued ones */
+	spin_lock_irq(&node->queue_lock);
+	node->queue_dead = 1;
+	spin_unlock_irq(&node->queue_lock);
+	flush_work(&node->queue_work);
+
+	/* Wait for in-flight transactions, later callers holding a
+	 * reference will see a NULL client.
+	 */
+	mutex_lock(&node->access_lock);
+	node->client = NULL;
+	regmap_exit(node->regmap);
+	node->regmap = NULL;
+	mutex_unlock(&node->access_lock);
+
+	omp800_cpld_put_node(node);
 }
 
-static ssize_t show_data(struct device *dev, struct device_attribute *da,
-			 char *buf)
+static int omp800_cpld_shadow_index(u8 reg)
 {
-	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
-	struct i2c_client *client = to_i2c_client(dev);
-	struct omp800_cpld_data *data = i2c_get_clientdata(client);
-	int val;
+	int i;
 
-	switch (attr->index) {
-	case VERSION:
-		val = data->version;
-		break;
-	case CPU_ID:
-		val = (data->slot_id & 0x80) >> 7;
-		break;
-	case CARD_TYPE:
-		val = (data->slot_id & 0x10) >> 4;
-		break;
-	case CARD_SLOT_ID:
-		val = (data->slot_id & 0x7);
-		break;
-	case CHASSIS_SLOT_ID:
-		val = (data->slot_id & 0x8) >> 3;
-		break;
-	default:
-		return -ENOENT;
-	};
+	for (i = 0; i < ARRAY_SIZE(shadow_regs); i++) {
+		if (shadow_regs[i] == reg) {
+			return i;
+		}
+	}
 
-	return sprintf(buf, "%d\n", val);
+	return -1;
 }
 
-struct reg_data_byte {
-	u8	 reg;
-	u8	*value;
-};
+/* Keep the shadow in sync with every value read from or written to the
+ * hardware. Caller must hold node->access_lock.
+ */
+static void omp800_cpld_shadow_store(struct cpld_client_node *node, u8 reg, const u8 *values, int len)
+{
+	int i;
 
-static struct omp800_cpld_data *omp800_cpld_update_temp(struct device *dev)
+	for (i = 0; i < len; i++) {
+		int index = omp800_cpld_shadow_index(reg + i);
+
+		if (index < 0) {
+			continue;
+		}
+
+		node->shadow[index] = values[i];
+		node->shadow_valid |= BIT(index);
+	}
+}
+
+static int omp800_cpld_node_read(struct cpld_client_node *node, u8 reg)
 {
-	struct i2c_client *client = to_i2c_client(dev);
-	struct omp800_cpld_data *data = i2c_get_clientdata(client);
+	unsigned int value;
+	int ret = -ENODEV;
 
-	mutex_lock(&data->update_lock);
+	mutex_lock(&node->access_lock);
+	if (node->regmap) {
+		ret = regmap_read(node->regmap, reg, &value);
+	}
+	if (!ret) {
+		u8 val = value;
+		omp800_cpld_shadow_store(node, reg, &val, 1);
+	}
+	mutex_unlock(&node->access_lock);
 
-	if (time_after(jiffies, data->last_updated + HZ + HZ / 2) || 
-		!data->valid) {
-		int i;
-		struct reg_data_byte regs_byte[] = { {temp_regs[0], &data->temp_input[0]},
-											 {temp_regs[1], &data->temp_input[1]}};
+	return (ret < 0) ? ret : value;
+}
 
-		dev_dbg(&client->dev, "Starting omp800_cpld temp update\n");
-		data->valid = 0;
-		
-		/* Update temp data
-		 */
-		for (i = 0; i < ARRAY_SIZE(regs_byte); i++) {
-			int status = i2c_smbus_read_byte_data(client, regs_byte[i].reg);
-			
-			if (status < 0) {
-				dev_dbg(&client->dev, "reg %x, err %d\n", regs_byte[i].reg, status);
-				goto exit;
-			}
-			else {
-				*(regs_byte[i].value) = (s8)status;
-			}
-		}
-		
-		data->last_updated = jiffies;
-		data->valid = 1;
+static int omp800_cpld_node_write(struct cpld_client_node *node, u8 reg, u8 value)
+{
+	int ret = -ENODEV;
+
+	mutex_lock(&node->access_lock);
+	if (node->regmap) {
+		ret = regmap_write(node->regmap, reg, value);
 	}
+	if (!ret) {
+		omp800_cpld_shadow_store(node, reg, &value, 1);
+	}
+	mutex_unlock(&node->access_lock);
 
-exit:
-	mutex_unlock(&data->update_lock);
-	return data;
+	return ret;
 }
 
-static ssize_t set_temp(struct device *dev, struct device_attribute *da,
-			const char *buf, size_t count) 
+/* Atomic read-modify-write. The read is skipped if the register is
+ * shadowed and the shadow is valid, so a control bit costs one write; the
+ * write is skipped if nothing changes. Registers like 0x8 are volatile,
+ * regmap_update_bits() would read them from the bus every time.
+ */
+static int omp800_cpld_node_update_bits(struct cpld_client_node *node, u8 reg, u8 mask, u8 value)
 {
-	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
-	struct i2c_client *client = to_i2c_client(dev);
-	struct omp800_cpld_data *data = i2c_get_clientdata(client);
-	int nr = attr->index - CPU_THERMAL;
-	long temp_input;
-	int error;
+	int index = omp800_cpld_shadow_index(reg);
+	unsigned int orig;
+	u8 new;
+	int ret = -ENODEV;
 
-	error = kstrtol(buf, 10, &temp_input);
-	if (error) {
-		return error;
+	mutex_lock(&node->access_lock);
+
+	if (!node->regmap) {
+		goto exit;
 	}
 
-	if (temp_input < -128 || temp_input > 127) {
-		return -EINVAL;
+	if (index >= 0 && (node->shadow_valid & BIT(index))) {
+		orig = node->shadow[index];
 	}
+	else {
+		ret = regmap_read(node->regmap, reg, &orig);
+		if (ret < 0) {
+			goto exit;
+		}
 
-	mutex_lock(&data->update_lock);
-	data->temp_input[nr] = temp_input;
-	error = i2c_smbus_write_byte_data(client, temp_regs[nr], (s8)temp_input);
-	mutex_unlock(&data->update_lock);
+		new = orig;
+		omp800_cpld_shadow_store(node, reg, &new, 1);
+	}
 
-	return count;
+	new = (orig & ~mask) | (value & mask);
+	if (new == orig) {
+		ret = 0;
+		goto exit;
+	}
+
+	ret = regmap_write(node->regmap, reg, new);
+	if (ret < 0) {
+		/* The register state is unknown now, read it back next time */
+		if (index >= 0) {
+			node->shadow_valid &= ~BIT(index);
+		}
+		goto exit;
+	}
+
+	omp800_cpld_shadow_store(node, reg, &new, 1);
+
+exit:
+	mutex_unlock(&node->access_lock);
+	return ret;
 }
 
-static ssize_t show_temp(struct device *dev, struct device_attribute *da,
-			 char *buf)
+/* Read/write len contiguous registers starting from reg. regmap-i2c picks
+ * raw I2C, SMBus I2C block or byte access depending on the adapter.
+ */
+static int omp800_cpld_node_read_block(struct cpld_client_node *node, u8 reg, u8 len, u8 *values)
 {
-	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
-	struct omp800_cpld_data *data = omp800_cpld_update_temp(dev);
+	int ret = -ENODEV;
 
-	if (!data->valid) {
-		return 0;
+	if (!len || len > OMP800_CPLD_BLOCK_MAX) {
+		return -EINVAL;
 	}
 
-	return sprintf(buf, "%d\n", data->temp_input[attr->index - CPU_THERMAL]);
+	mutex_lock(&node->access_lock);
+	if (node->regmap) {
+		ret = regmap_bulk_read(node->regmap, reg, values, len);
+	}
+	if (!ret) {
+		omp800_cpld_shadow_store(node, reg, values, len);
+	}
+	mutex_unlock(&node->access_lock);
+
+	return (ret < 0) ? ret : len;
 }
 
-static ssize_t set_cpu_mac_reset(struct device *dev, struct device_attribute *da,
-			const char *buf, size_t count) 
+static int omp800_cpld_node_write_block(struct cpld_client_node *node, u8 reg, u8 len, const u8 *values)
 {
-	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
-	struct i2c_client *client = to_i2c_client(dev);
-	int status, mask = 0;
-	long reset;
+	int ret = -ENODEV;
 
-	status = kstrtol(buf, 10, &reset);
-	if (unlikely(status)) {
-		return status;
+	if (!len || len > OMP800_CPLD_BLOCK_MAX) {
+		return -EINVAL;
 	}
 
-	/* Read reset status */
-	status = i2c_smbus_read_byte_data(client, 0x8);
-	DEBUG_PRINT("Reset reg (0x8) status = (0x%x)", status);
-	if (unlikely(status < 0)) {
-		return status;
+	mutex_lock(&node->access_lock);
+	if (node->regmap) {
+		ret = regmap_bulk_write(node->regmap, reg, values, len);
 	}
-	
-	switch (attr->index) {
-		case RESET_CPU_A:
-			mask = 0x1;
-			break;
-		case RESET_CPU_B:
-			mask = 0x10;
-			break;
-		case RESET_MAC_A:
-			mask = 0x2;
-			break;
-		case RESET_MAC_B:
-			mask = 0x20;
-			break;
-		default:
-			break;
+	if (!ret) {
+		omp800_cpld_shadow_store(node, reg, values, len);
 	}
+	mutex_unlock(&node->access_lock);
 
-	status = reset ? (status & ~mask) : (status | mask);
-	DEBUG_PRINT("Reset reg (0x8) write data = (0x%x)", status);
-	status = i2c_smbus_write_byte_data(client, 0x8, status);
-	
-	if (unlikely(status < 0)) {
-		return status;
+	return (ret < 0) ? ret : len;
+}
+
+/* Read num non-contiguous registers. On a plain I2C adapter all of them
+ * are combined into one i2c_transfer() with repeated starts, bypassing the
+ * register cache, otherwise each register is read through regmap.
+ */
+static int omp800_cpld_node_read_regs(struct cpld_client_node *node, const u8 *regs, u8 *values, int num)
+{
+	struct i2c_client *client;
+	struct i2c_msg *msgs = NULL;
+	u8 *reg_buf = NULL;
+	int i, ret = -ENODEV;
+
+	if (num <= 0 || num > OMP800_CPLD_BLOCK_MAX) {
+		return -EINVAL;
+	}
+
+	mutex_lock(&node->access_lock);
+
+	client = node->client;
+	if (!client) {
+		goto exit;
+	}
+
+	if (!i2c_check_functionality(client->adapter, I2C_FUNC_I2C)) {
+		unsigned int value;
+
+		for (i = 0; i < num; i++) {
+			ret = regmap_read(node->regmap, regs[i], &value);
+			if (ret < 0) {
+				goto exit;
+			}
+
+			values[i] = value;
+			omp800_cpld_shadow_store(node, regs[i], &values[i], 1);
+		}
+
+		goto exit;
+	}
+
+	msgs	= kcalloc(num * 2, sizeof(struct i2c_msg), GFP_KERNEL);
+	reg_buf = kmemdup(regs, num, GFP_KERNEL);
+	if (!msgs || !reg_buf) {
+		ret = -ENOMEM;
+		goto exit;
+	}
+
+	for (i = 0; i < num; i++) {
+		msgs[i*2].addr	   = client->addr;
+		msgs[i*2].len	   = 1;
+		msgs[i*2].buf	   = &reg_buf[i];
+		msgs[i*2 + 1].addr  = client->addr;
+		msgs[i*2 + 1].flags = I2C_M_RD;
+		msgs[i*2 + 1].len   = 1;
+		msgs[i*2 + 1].buf   = &values[i];
+	}
+
+	ret = i2c_transfer(client->adapter, msgs, num * 2);
+	if (ret >= 0 && ret != num * 2) {
+		ret = -EIO;
+	}
+
+	for (i = 0; ret >= 0 && i < num; i++) {
+		omp800_cpld_shadow_store(node, regs[i], &values[i], 1);
+	}
+
+exit:
+	mutex_unlock(&node->access_lock);
+	kfree(reg_buf);
+	kfree(msgs);
+	return (ret < 0) ? ret : num;
+}
+
+/* Number of requests from req on that can be merged into one block
+ * transfer: reads or writes of contiguous registers, in queue order.
+ */
+static int omp800_cpld_async_run(struct list_head *head, struct cpld_async_req *req)
+{
+	struct cpld_async_req *next = req;
+	int len = 1;
+
+	if (req->type == CPLD_ASYNC_UPDATE_BITS) {
+		return 1;
+	}
+
+	list_for_each_entry_continue(next, head, list) {
+		if (len == OMP800_CPLD_BLOCK_MAX || next->type != req->type ||
+			next->reg != req->reg + len) {
+			break;
+		}
+
+		len++;
+	}
+
+	return len;
+}
+
+/* Drain the request queue of a CPLD. Callbacks run here, in process
+ * context, in the order the requests were submitted.
+ */
+static void omp800_cpld_queue_work(struct work_struct *work)
+{
+	struct cpld_client_node *node = container_of(work, struct cpld_client_node, queue_work);
+	struct cpld_async_req *req, *tmp;
+	u8 values[OMP800_CPLD_BLOCK_MAX];
+	LIST_HEAD(batch);
+	int i, len, status;
+
+	spin_lock_irq(&node->queue_lock);
+	list_splice_init(&node->queue, &batch);
+	spin_unlock_irq(&node->queue_lock);
+
+	while (!list_empty(&batch)) {
+		req = list_first_entry(&batch, struct cpld_async_req, list);
+		len = omp800_cpld_async_run(&batch, req);
+
+		tmp = req;
+		for (i = 0; i < len; i++) {
+			values[i] = tmp->value;
+			tmp = list_next_entry(tmp, list);
+		}
+
+		switch (req->type) {
+		case CPLD_ASYNC_READ:
+			status = omp800_cpld_node_read_block(node, req->reg, len, values);
+			break;
+		case CPLD_ASYNC_WRITE:
+			status = omp800_cpld_node_write_block(node, req->reg, len, values);
+			break;
+		default:
+			status = omp800_cpld_node_update_bits(node, req->reg, req->mask, req->value);
+			break;
+		}
+
+		if (status < 0) {
+			DEBUG_PRINT("cpld async type(%d) reg(0x%x) len(%d) failed (%d)",
+						req->type, req->reg, len, status);
+		}
+
+		for (i = 0; i < len; i++) {
+			req = list_first_entry(&batch, struct cpld_async_req, list);
+			list_del(&req->list);
+
+			if (req->complete) {
+				req->complete(req->context, (status < 0) ? status : 0, values[i]);
+			}
+
+			kfree(req);
+		}
+	}
+}
+
+/* Queue a request without waiting for the bus, safe to call from atomic
+ * context. complete() is optional except for reads.
+ */
+static int omp800_cpld_submit(unsigned short cpld_addr, u8 type, u8 reg, u8 mask, u8 value,
+							  void (*complete)(void *context, int status, u8 value),
+							  void *context)
+{
+	struct cpld_client_node *node;
+	struct cpld_async_req *req;
+	unsigned long flags;
+	int ret = 0;
+
+	req = kzalloc(sizeof(struct cpld_async_req), GFP_ATOMIC);
+	if (!req) {
+		return -ENOMEM;
+	}
+
+	req->type	  = type;
+	req->reg	  = reg;
+	req->mask	  = mask;
+	req->value	  = value;
+	req->complete = complete;
+	req->context  = context;
+
+	node = omp800_cpld_get_node(cpld_addr);
+	if (!node) {
+		kfree(req);
+		return -EIO;
+	}
+
+	spin_lock_irqsave(&node->queue_lock, flags);
+	if (node->queue_dead) {
+		ret = -ENODEV;
+	}
+	else {
+		list_add_tail(&req->list, &node->queue);
+		schedule_work(&node->queue_work);
+	}
+	spin_unlock_irqrestore(&node->queue_lock, flags);
+
+	omp800_cpld_put_node(node);
+
+	if (ret < 0) {
+		kfree(req);
+	}
+
+	return ret;
+}
+
+static ssize_t show_data(struct device *dev, struct device_attribute *da,
+			 char *buf)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_cpld_data *data = i2c_get_clientdata(client);
+	int val;
+
+	switch (attr->index) {
+	case VERSION:
+		val = data->version;
+		break;
+	case CPU_ID:
+		val = (data->slot_id & 0x80) >> 7;
+		break;
+	case CARD_TYPE:
+		val = (data->slot_id & 0x10) >> 4;
+		break;
+	case CARD_SLOT_ID:
+		val = (data->slot_id & 0x7);
+		break;
+	case CHASSIS_SLOT_ID:
+		val = (data->slot_id & 0x8) >> 3;
+		break;
+	default:
+		return -ENOENT;
+	};
+
+	return sprintf(buf, "%d\n", val);
+}
+
+static struct omp800_cpld_data *omp800_cpld_update_temp(struct device *dev)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_cpld_data *data = i2c_get_clientdata(client);
+
+	mutex_lock(&data->update_lock);
+
+	if (time_after(jiffies, data->last_updated + HZ + HZ / 2) || 
+		!data->valid) {
+		int status;
+
+		dev_dbg(&client->dev, "Starting omp800_cpld temp update\n");
+		data->valid = 0;
+		
+		/* Update temp data, CPU/MAC thermal registers are contiguous
+		 */
+		status = omp800_cpld_node_read_block(data->node, temp_regs[0], ARRAY_SIZE(temp_regs),
+											 (u8 *)data->temp_input);
+		if (status < 0) {
+			dev_dbg(&client->dev, "reg %x, err %d\n", temp_regs[0], status);
+			goto exit;
+		}
+		
+		data->last_updated = jiffies;
+		data->valid = 1;
+	}
+
+exit:
+	mutex_unlock(&data->update_lock);
+	return data;
+}
+
+static ssize_t set_temp(struct device *dev, struct device_attribute *da,
+			const char *buf, size_t count) 
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_cpld_data *data = i2c_get_clientdata(client);
+	int nr = attr->index - CPU_THERMAL;
+	long temp_input;
+	int error;
+
+	error = kstrtol(buf, 10, &temp_input);
+	if (error) {
+		return error;
+	}
+
+	if (temp_input < -128 || temp_input > 127) {
+		return -EINVAL;
+	}
+
+	mutex_lock(&data->update_lock);
+	data->temp_input[nr] = temp_input;
+	data->temp_fed_valid &= ~BIT(nr);
+	error = omp800_cpld_node_write(data->node, temp_regs[nr], (s8)temp_input);
+	mutex_unlock(&data->update_lock);
+
+	return count;
+}
+
+static ssize_t show_temp(struct device *dev, struct device_attribute *da,
+			 char *buf)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct omp800_cpld_data *data = omp800_cpld_update_temp(dev);
+
+	if (!data->valid) {
+		return 0;
+	}
+
+	return sprintf(buf, "%d\n", data->temp_input[attr->index - CPU_THERMAL]);
+}
+
+static int omp800_cpld_get_cpu_temp(const char *zone, int *temp)
+{
+	struct thermal_zone_device *tz = thermal_zone_get_zone_by_name(zone);
+
+	if (IS_ERR(tz)) {
+		return PTR_ERR(tz);
+	}
+
+	return thermal_zone_get_temp(tz, temp);
+}
+
+static int omp800_cpld_get_mac_temp(int *temp)
+{
+	int ret = -ENODEV;
+
+	mutex_lock(&mac_temp_lock);
+	if (mac_temp_provider.get_temp) {
+		ret = mac_temp_provider.get_temp(mac_temp_provider.priv, temp);
+	}
+	mutex_unlock(&mac_temp_lock);
+
+	return ret;
+}
+
+static void omp800_cpld_temp_feed(struct work_struct *work)
+{
+	struct omp800_cpld_data *data = container_of(to_delayed_work(work),
+										struct omp800_cpld_data, temp_feed_work);
+	char zone[THERMAL_NAME_LENGTH];
+	unsigned int interval;
+	int i, status, temp[2];
+	u8 valid = 0, changed = 0;
+	s8 values[2];
+
+	mutex_lock(&data->update_lock);
+	memcpy(zone, data->temp_feed_zone, sizeof(zone));
+	mutex_unlock(&data->update_lock);
+
+	status = omp800_cpld_get_cpu_temp(zone, &temp[0]);
+	if (status) {
+		dev_dbg(data->hwmon_dev, "temp feed, %s err %d\n", zone, status);
+	}
+	else {
+		valid |= BIT(0);
+	}
+
+	status = omp800_cpld_get_mac_temp(&temp[1]);
+	if (status) {
+		dev_dbg(data->hwmon_dev, "temp feed, mac err %d\n", status);
+	}
+	else {
+		valid |= BIT(1);
+	}
+
+	mutex_lock(&data->update_lock);
+
+	for (i = 0; i < ARRAY_SIZE(values); i++) {
+		if (!(valid & BIT(i))) {
+			continue;
+		}
+
+		values[i] = clamp_val(DIV_ROUND_CLOSEST(temp[i], 1000), -128, 127);
+
+		if (!(data->temp_fed_valid & BIT(i)) || data->temp_fed[i] != values[i]) {
+			changed |= BIT(i);
+		}
+	}
+
+	/* Only write the registers whose value changed */
+	if (changed == (BIT(0) | BIT(1))) {
+		status = omp800_cpld_node_write_block(data->node, temp_regs[0], ARRAY_SIZE(values), (u8 *)values);
+	}
+	else if (changed) {
+		i = (changed & BIT(0)) ? 0 : 1;
+		status = omp800_cpld_node_write(data->node, temp_regs[i], values[i]);
+	}
+	else {
+		status = 0;
+	}
+
+	if (status < 0) {
+		dev_dbg(data->hwmon_dev, "temp feed, reg 0x%x err %d\n",
+				temp_regs[(changed & BIT(0)) ? 0 : 1], status);
+		data->temp_feed_errors++;
+	}
+	else {
+		for (i = 0; i < ARRAY_SIZE(values); i++) {
+			if (changed & BIT(i)) {
+				data->temp_fed[i]	 = values[i];
+				data->temp_input[i] = values[i];
+				data->temp_fed_valid |= BIT(i);
+			}
+		}
+	}
+
+	interval = data->temp_feed_interval;
+	mutex_unlock(&data->update_lock);
+
+	if (interval) {
+		schedule_delayed_work(&data->temp_feed_work, msecs_to_jiffies(interval));
+	}
+}
+
+static ssize_t show_temp_feed(struct device *dev, struct device_attribute *da,
+			 char *buf)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_cpld_data *data = i2c_get_clientdata(client);
+	ssize_t ret;
+
+	mutex_lock(&data->update_lock);
+	if (attr->index == TEMP_FEED_INTERVAL) {
+		ret = sprintf(buf, "%u\n", data->temp_feed_interval);
+	}
+	else if (attr->index == TEMP_FEED_ERRORS) {
+		ret = sprintf(buf, "%u\n", data->temp_feed_errors);
+	}
+	else {
+		ret = sprintf(buf, "%s\n", data->temp_feed_zone);
+	}
+	mutex_unlock(&data->update_lock);
+
+	return ret;
+}
+
+static ssize_t set_temp_feed(struct device *dev, struct device_attribute *da,
+			const char *buf, size_t count)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_cpld_data *data = i2c_get_clientdata(client);
+	unsigned int interval;
+	size_t len;
+	int error;
+
+	if (attr->index == TEMP_FEED_CPU_ZONE) {
+		len = strcspn(buf, "\n");
+		if (!len || len >= THERMAL_NAME_LENGTH) {
+			return -EINVAL;
+		}
+
+		mutex_lock(&data->update_lock);
+		memcpy(data->temp_feed_zone, buf, len);
+		data->temp_feed_zone[len] = '\0';
+		mutex_unlock(&data->update_lock);
+
+		return count;
+	}
+
+	error = kstrtouint(buf, 10, &interval);
+	if (error) {
+		return error;
+	}
+
+	mutex_lock(&data->update_lock);
+	data->temp_feed_interval = interval;
+	mutex_unlock(&data->update_lock);
+
+	if (interval) {
+		mod_delayed_work(system_wq, &data->temp_feed_work, 0);
+	}
+	else {
+		cancel_delayed_work_sync(&data->temp_feed_work);
+	}
+
+	return count;
+}
+
+static void omp800_cpld_poll(struct work_struct *work)
+{
+	struct omp800_cpld_data *data = container_of(to_delayed_work(work),
+										struct omp800_cpld_data, poll_work);
+	const struct cpld_poll_desc *poll = data->poll;
+	u8 values[CPLD_POLL_MAX_REGS];
+	unsigned long changed = 0;
+	unsigned int interval;
+	int i, j, status;
+
+	status = omp800_cpld_node_read_regs(data->node, poll->regs, values, poll->num_regs);
+
+	mutex_lock(&data->update_lock);
+
+	if (status < 0) {
+		dev_dbg(data->hwmon_dev, "status poll, err %d\n", status);
+		data->poll_valid = 0;
+		goto exit;
+	}
+
+	for (i = 0; data->poll_valid && i < poll->num_attrs; i++) {
+		for (j = 0; j < poll->num_regs; j++) {
+			if (poll->regs[j] != poll->attrs[i].reg) {
+				continue;
+			}
+
+			if ((data->poll_val[j] ^ values[j]) & poll->attrs[i].mask) {
+				changed |= BIT(i);
+			}
+		}
+	}
+
+	memcpy(data->poll_val, values, poll->num_regs);
+	data->poll_valid = 1;
+
+exit:
+	interval = data->poll_interval;
+	mutex_unlock(&data->update_lock);
+
+	for (i = 0; i < poll->num_attrs; i++) {
+		if (changed & BIT(i)) {
+			sysfs_notify(&data->node->client->dev.kobj, NULL, poll->attrs[i].name);
+		}
+	}
+
+	if (interval) {
+		schedule_delayed_work(&data->poll_work, msecs_to_jiffies(interval));
+	}
+}
+
+/* Serve a polled status register from the last sample while the poller
+ * is running, otherwise read it from the CPLD.
+ */
+static int omp800_cpld_read_status(struct omp800_cpld_data *data, u8 reg)
+{
+	int i, status = -1;
+
+	mutex_lock(&data->update_lock);
+
+	if (data->poll && data->poll_interval && data->poll_valid) {
+		for (i = 0; i < data->poll->num_regs; i++) {
+			if (data->poll->regs[i] == reg) {
+				status = data->poll_val[i];
+				break;
+			}
+		}
+	}
+
+	mutex_unlock(&data->update_lock);
+
+	return (status < 0) ? omp800_cpld_node_read(data->node, reg) : status;
+}
+
+static ssize_t show_present_status(struct device *dev, struct device_attribute *da,
+			 char *buf)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_cpld_data *data = i2c_get_clientdata(client);
+	int status = omp800_cpld_read_status(data, 0x48);
+
+	if (status < 0) {
+		return status;
+	}
+
+	return sprintf(buf, "0x%x\n", status);
+}
+
+static ssize_t show_poll_interval(struct device *dev, struct device_attribute *da,
+			 char *buf)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_cpld_data *data = i2c_get_clientdata(client);
+
+	return sprintf(buf, "%u\n", data->poll_interval);
+}
+
+static ssize_t set_poll_interval(struct device *dev, struct device_attribute *da,
+			const char *buf, size_t count)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_cpld_data *data = i2c_get_clientdata(client);
+	unsigned int interval;
+	int error;
+
+	error = kstrtouint(buf, 10, &interval);
+	if (error) {
+		return error;
+	}
+
+	mutex_lock(&data->update_lock);
+	data->poll_interval = interval;
+	mutex_unlock(&data->update_lock);
+
+	if (interval) {
+		mod_delayed_work(system_wq, &data->poll_work, 0);
+	}
+	else {
+		cancel_delayed_work_sync(&data->poll_work);
+	}
+
+	return count;
+}
+
+static ssize_t set_cpu_mac_reset(struct device *dev, struct device_attribute *da,
+			const char *buf, size_t count) 
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_cpld_data *data = i2c_get_clientdata(client);
+	int i, status, mask = 0;
+	long reset;
+
+	status = kstrtol(buf, 10, &reset);
+	if (unlikely(status)) {
+		return status;
+	}
+
+	switch (attr->index) {
+		case RESET_CPU_A:
+			mask = 0x1;
+			break;
+		case RESET_CPU_B:
+			mask = 0x10;
+			break;
+		case RESET_MAC_A:
+			mask = 0x2;
+			break;
+		case RESET_MAC_B:
+			mask = 0x20;
+			break;
+		default:
+			break;
+	}
+
+	/* Reset bits are active low */
+	DEBUG_PRINT("Reset reg (0x8) mask = (0x%x), reset = (%ld)", mask, reset);
+	status = omp800_cpld_node_update_bits(data->node, 0x8, mask, reset ? 0 : mask);
+	
+	if (unlikely(status < 0)) {
+		return status;
+	}
+
+	/* Fold the written bits into the poll sample so readers see the new
+	 * state at once, the poller would not flag it against that baseline
+	 * so wake the waiters here.
+	 */
+	mutex_lock(&data->update_lock);
+
+	if (data->poll && data->poll_valid) {
+		for (i = 0; i < data->poll->num_regs; i++) {
+			if (data->poll->regs[i] == 0x8) {
+				data->poll_val[i] = (data->poll_val[i] & ~mask) | (reset ? 0 : mask);
+			}
+		}
+	}
+
+	mutex_unlock(&data->update_lock);
+	sysfs_notify(&dev->kobj, NULL, da->attr.name);
+
+	return count;
+}
+
+static ssize_t show_cpu_mac_reset(struct device *dev, struct device_attribute *da,
+			 char *buf)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_cpld_data *data = i2c_get_clientdata(client);
+	int status, mask = 0;
+
+	/* Read reset status */
+	status = omp800_cpld_read_status(data, 0x8);
+	if (unlikely(status < 0)) {
+		return status;
+	}
+	
+	switch (attr->index) {
+		case RESET_CPU_A:
+			mask = 0x1;
+			break;
+		case RESET_CPU_B:
+			mask = 0x10;
+			break;
+		case RESET_MAC_A:
+			mask = 0x2;
+			break;
+		case RESET_MAC_B:
+			mask = 0x20;
+			break;
+		default:
+			break;
+	}
+
+	return sprintf(buf, "%d\n", !(status & mask));
+}
+
+static void omp800_cpld_inventory_refresh(struct work_struct *work)
+{
+	unsigned int interval;
+	int i;
+
+	for (i = 0; i < OMP800_CPLD_ADDR_NUM; i++) {
+		struct slot_inventory *slot = &inventory.slot[i];
+		struct cpld_client_node *node;
+		u8 regs[INVENTORY_REG_NUM];
+		int status = -ENODEV;
+
+		node = __omp800_cpld_get_node(remote_cpld_clients, OMP800_CPLD_ADDR_BASE + i);
+		if (node) {
+			status = omp800_cpld_node_read_block(node, INVENTORY_REG_BEGIN, sizeof(regs), regs);
+			omp800_cpld_put_node(node);
+		}
+
+		mutex_lock(&inventory.lock);
+		slot->registered = !!node;
+		slot->present	 = (status >= 0);
+
+		if (status >= 0) {
+			slot->version	= regs[0x1 - INVENTORY_REG_BEGIN];
+			slot->slot_id	= regs[0x2 - INVENTORY_REG_BEGIN];
+			slot->reset		= regs[0x8 - INVENTORY_REG_BEGIN];
+			slot->last_seen = jiffies;
+		}
+		mutex_unlock(&inventory.lock);
+	}
+
+	mutex_lock(&inventory.lock);
+	interval = inventory.interval;
+	mutex_unlock(&inventory.lock);
+
+	if (interval) {
+		schedule_delayed_work(&inventory.work, msecs_to_jiffies(interval));
+	}
+}
+
+/* One line per instantiated remote CPLD:
+ * <addr> <present> <version> <card type> <card slot id> <reset reg> <last seen, ms ago or -1>
+ */
+static ssize_t show_inventory(struct device *dev, struct device_attribute *da,
+			 char *buf)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	ssize_t len = 0;
+	int i;
+
+	mutex_lock(&inventory.lock);
+
+	if (attr->index == INVENTORY_INTERVAL) {
+		len = sprintf(buf, "%u\n", inventory.interval);
+		goto exit;
+	}
+
+	for (i = 0; i < OMP800_CPLD_ADDR_NUM; i++) {
+		struct slot_inventory *slot = &inventory.slot[i];
+
+		if (!slot->registered) {
+			continue;
+		}
+
+		len += sprintf(buf + len, "0x%x %d 0x%x %d %d 0x%x %ld\n",
+					   OMP800_CPLD_ADDR_BASE + i, slot->present, slot->version,
+					   (slot->slot_id & 0x10) >> 4, (slot->slot_id & 0x7), slot->reset,
+					   slot->last_seen ? (long)jiffies_to_msecs(jiffies - slot->last_seen) : -1L);
+	}
+
+exit:
+	mutex_unlock(&inventory.lock);
+	return len;
+}
+
+static ssize_t set_inventory_interval(struct device *dev, struct device_attribute *da,
+			const char *buf, size_t count)
+{
+	unsigned int interval;
+	int error;
+
+	error = kstrtouint(buf, 10, &interval);
+	if (error) {
+		return error;
+	}
+
+	mutex_lock(&inventory.lock);
+	inventory.interval = interval;
+	mutex_unlock(&inventory.lock);
+
+	if (interval) {
+		mod_delayed_work(system_wq, &inventory.work, 0);
+	}
+	else {
+		cancel_delayed_work_sync(&inventory.work);
+	}
+
+	return count;
+}
+
+/* Assert the selected reset bits on every selected slot back-to-back, hold
+ * them for the pulse width and release them together. Reg 0x8 of each slot
+ * is read once up front to prime its shadow, so each assert/release is then
+ * a single write per slot.
+ */
+static int omp800_cpld_chassis_reset(u8 slot_mask, u8 component_mask)
+{
+	struct cpld_client_node *nodes[OMP800_CPLD_ADDR_NUM] = { NULL };
+	u8 asserted = 0, failed = 0;
+	ktime_t start, assert_done, hold_done, release_done;
+	int i, status = 0;
+
+	for (i = 0; i < OMP800_CPLD_ADDR_NUM; i++) {
+		if (!(slot_mask & BIT(i))) {
+			continue;
+		}
+
+		nodes[i] = __omp800_cpld_get_node(remote_cpld_clients, OMP800_CPLD_ADDR_BASE + i);
+		if (!nodes[i]) {
+			status = -ENXIO;
+			goto exit;
+		}
+	}
+
+	for (i = 0; i < OMP800_CPLD_ADDR_NUM; i++) {
+		if (nodes[i] && omp800_cpld_node_read(nodes[i], 0x8) < 0) {
+			failed |= BIT(i);
+		}
+	}
+
+	start = ktime_get();
+
+	for (i = 0; i < OMP800_CPLD_ADDR_NUM; i++) {
+		if (!nodes[i] || (failed & BIT(i))) {
+			continue;
+		}
+
+		/* Reset bits are active low */
+		if (omp800_cpld_node_update_bits(nodes[i], 0x8, component_mask, 0) < 0) {
+			failed |= BIT(i);
+			continue;
+		}
+
+		asserted |= BIT(i);
+	}
+
+	assert_done = ktime_get();
+	msleep(chassis_reset.pulse);
+	hold_done = ktime_get();
+
+	for (i = 0; i < OMP800_CPLD_ADDR_NUM; i++) {
+		if (!(asserted & BIT(i))) {
+			continue;
+		}
+
+		if (omp800_cpld_node_update_bits(nodes[i], 0x8, component_mask, component_mask) < 0) {
+			failed |= BIT(i);
+		}
+	}
+
+	release_done = ktime_get();
+
+	chassis_reset.slot_mask		 = slot_mask;
+	chassis_reset.component_mask = component_mask;
+	chassis_reset.failed_mask	 = failed;
+	chassis_reset.assert_us		 = ktime_us_delta(assert_done, start);
+	chassis_reset.hold_us		 = ktime_us_delta(hold_done, assert_done);
+	chassis_reset.release_us	 = ktime_us_delta(release_done, hold_done);
+
+	if (failed) {
+		status = -EIO;
+	}
+
+exit:
+	for (i = 0; i < OMP800_CPLD_ADDR_NUM; i++) {
+		if (nodes[i]) {
+			omp800_cpld_put_node(nodes[i]);
+		}
+	}
+
+	return status;
+}
+
+/* chassis_reset: write "<slot mask> <component mask>" in hex, bit n of the
+ * slot mask selects remote CPLD 0x60+n. Read back the last operation as
+ * <slot mask> <component mask> <failed slot mask> <assert us> <hold us> <release us>
+ */
+static ssize_t show_chassis_reset(struct device *dev, struct device_attribute *da,
+			 char *buf)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	ssize_t ret;
+
+	mutex_lock(&chassis_reset.lock);
+
+	if (attr->index == CHASSIS_RESET_PULSE) {
+		ret = sprintf(buf, "%u\n", chassis_reset.pulse);
+	}
+	else {
+		ret = sprintf(buf, "0x%x 0x%x 0x%x %lld %lld %lld\n",
+					  chassis_reset.slot_mask, chassis_reset.component_mask,
+					  chassis_reset.failed_mask, chassis_reset.assert_us,
+					  chassis_reset.hold_us, chassis_reset.release_us);
+	}
+
+	mutex_unlock(&chassis_reset.lock);
+	return ret;
+}
+
+static ssize_t set_chassis_reset(struct device *dev, struct device_attribute *da,
+			const char *buf, size_t count)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	unsigned int slot_mask, component_mask, pulse;
+	int status;
+
+	if (attr->index == CHASSIS_RESET_PULSE) {
+		status = kstrtouint(buf, 10, &pulse);
+		if (status) {
+			return status;
+		}
+
+		if (pulse > CHASSIS_RESET_MAX_PULSE) {
+			return -EINVAL;
+		}
+
+		mutex_lock(&chassis_reset.lock);
+		chassis_reset.pulse = pulse;
+		mutex_unlock(&chassis_reset.lock);
+
+		return count;
+	}
+
+	if (sscanf(buf, "%x %x", &slot_mask, &component_mask) != 2) {
+		return -EINVAL;
+	}
+
+	if (!slot_mask || slot_mask >= BIT(OMP800_CPLD_ADDR_NUM) ||
+		!component_mask || (component_mask & ~CHASSIS_RESET_COMPONENT_MASK)) {
+		return -EINVAL;
+	}
+
+	mutex_lock(&chassis_reset.lock);
+	status = omp800_cpld_chassis_reset(slot_mask, component_mask);
+	mutex_unlock(&chassis_reset.lock);
+
+	return (status < 0) ? status : count;
+}
+
+/* Write our next heartbeat, with or without claim. Caller must hold
+ * ownership.lock.
+ */
+static void omp800_cpld_ownership_beat(int claim)
+{
+	int status;
+
+	ownership.beat = (ownership.cpu_id ? OWNERSHIP_BEAT_CPU_B : 0) |
+					 (claim ? OWNERSHIP_BEAT_CLAIM : 0) |
+					 ((ownership.beat + 1) & OWNERSHIP_BEAT_COUNT_MASK);
+
+	status = omp800_cpld_node_write(ownership.node, OWNERSHIP_HEARTBEAT_REG, ownership.beat);
+	if (status < 0) {
+		dev_dbg(&ownership.node->client->dev, "reg %d, err %d\n", OWNERSHIP_HEARTBEAT_REG, status);
+	}
+}
+
+static void omp800_cpld_ownership_check(struct work_struct *work)
+{
+	struct cpld_client_node *node;
+	struct device *dev;
+	unsigned int interval;
+	int beat = -1, reset, state, peer_reset, peer_beat = 0, release = 0;
+	u8 peer;
+
+	mutex_lock(&ownership.lock);
+
+	node  = ownership.node;
+	dev	  = &node->client->dev;
+	state = ownership.state;
+
+	/* Reset of the peer CPU, active low */
+	peer	   = ownership.cpu_id ? 0x01 : 0x10;
+	reset	   = omp800_cpld_node_read(node, 0x8);
+	peer_reset = (reset >= 0 && !(reset & peer));
+
+	if (ownership.heartbeat) {
+		beat = omp800_cpld_node_read(node, OWNERSHIP_HEARTBEAT_REG);
+
+		/* Written by the peer since we last looked */
+		peer_beat = (beat >= 0 && beat != ownership.beat &&
+					 (beat & OWNERSHIP_BEAT_CPU_B) != (ownership.cpu_id ? OWNERSHIP_BEAT_CPU_B : 0));
+	}
+
+	if (!ownership.heartbeat) {
+		if (ownership.cpu_id && ownership.state == OWNER_STANDBY && peer_reset) {
+			dev_warn(dev, "CPU-A in reset, taking over fan/PDU control\n");
+			ownership.state = OWNER_ACTIVE;
+			ownership.takeovers++;
+		}
+		else if (ownership.cpu_id && ownership.state == OWNER_ACTIVE && reset >= 0 && !peer_reset) {
+			dev_info(dev, "CPU-A is out of reset, fan/PDU control on standby\n");
+			ownership.state = OWNER_STANDBY;
+		}
+	}
+	else if (ownership.state == OWNER_ACTIVE) {
+		/* CPU-B yields to any beat of CPU-A, CPU-A only to a claim of
+		 * CPU-B, i.e. CPU-B took over while CPU-A was stalled.
+		 */
+		if (peer_beat && (ownership.cpu_id || (beat & OWNERSHIP_BEAT_CLAIM))) {
+			dev_info(dev, "CPU-%c claims fan/PDU control, on standby\n",
+					 ownership.cpu_id ? 'A' : 'B');
+			ownership.state	 = OWNER_STANDBY;
+			ownership.beat	 = beat;
+			ownership.missed = 0;
+			release = 1;
+		}
+		else {
+			omp800_cpld_ownership_beat(1);
+		}
+	}
+	else {
+		if (peer_beat) {
+			ownership.beat	 = beat;
+			ownership.missed = 0;
+		}
+		else if (ownership.missed < OWNERSHIP_MISSED_BEATS) {
+			ownership.missed++;
+		}
+
+		if (peer_reset || ownership.missed >= OWNERSHIP_MISSED_BEATS ||
+			(!ownership.cpu_id && peer_beat && !(beat & OWNERSHIP_BEAT_CLAIM))) {
+			dev_warn(dev, "CPU-%c %s, taking over fan/PDU control\n",
+					 ownership.cpu_id ? 'A' : 'B',
+					 peer_reset ? "in reset" :
+					 (ownership.missed >= OWNERSHIP_MISSED_BEATS) ? "lost" : "released");
+			ownership.state	 = OWNER_ACTIVE;
+			ownership.missed = 0;
+			ownership.takeovers++;
+			omp800_cpld_ownership_beat(1);
+		}
+		else if (!ownership.cpu_id) {
+			/* Ask the owner to hand the control back */
+			omp800_cpld_ownership_beat(0);
+		}
+	}
+
+	if (state == ownership.state) {
+		state = OWNER_NONE;
+	}
+	else {
+		state = ownership.state;
+	}
+
+	interval = ownership.interval;
+	mutex_unlock(&ownership.lock);
+
+	if (state != OWNER_NONE) {
+		blocking_notifier_call_chain(&ownership.notifier, state, NULL);
+	}
+
+	/* Drop the claim only once the notifier users have stopped driving */
+	if (release) {
+		mutex_lock(&ownership.lock);
+		if (ownership.state == OWNER_STANDBY) {
+			omp800_cpld_ownership_beat(0);
+		}
+		mutex_unlock(&ownership.lock);
+	}
+
+	schedule_delayed_work(&ownership.work, msecs_to_jiffies(interval));
+}
+
+/* Write a beat without claim and read it back, a few times in case the
+ * peer beats in between. Returns the beat, < 0 if the register does not
+ * hold what is written to it.
+ */
+static int omp800_cpld_ownership_probe_reg(struct cpld_client_node *node, u8 cpu_id)
+{
+	u8 beat = (cpu_id ? OWNERSHIP_BEAT_CPU_B : 0) | 0x15;
+	int i, status;
+
+	for (i = 0; i < 3; i++, beat++) {
+		status = omp800_cpld_node_write(node, OWNERSHIP_HEARTBEAT_REG, beat);
+		if (status < 0) {
+			return status;
+		}
+
+		status = omp800_cpld_node_read(node, OWNERSHIP_HEARTBEAT_REG);
+		if (status < 0) {
+			return status;
+		}
+
+		if (status == beat) {
+			return beat;
+		}
+	}
+
+	return -EIO;
+}
+
+static void omp800_cpld_ownership_start(struct cpld_client_node *node, u8 cpu_id)
+{
+	int beat = ownership_heartbeat ? omp800_cpld_ownership_probe_reg(node, cpu_id) : -ENODEV;
+	u8 state = (cpu_id || beat >= 0) ? OWNER_STANDBY : OWNER_ACTIVE;
+
+	if (ownership_heartbeat && beat < 0) {
+		dev_warn(&node->client->dev, "ownership heartbeat unavailable (%d), CPU-A owns fan/PDU control\n",
+				 beat);
+	}
+
+	kref_get(&node->kref);
+
+	mutex_lock(&ownership.lock);
+	ownership.node		= node;
+	ownership.cpu_id	= cpu_id;
+	ownership.state		= state;
+	ownership.heartbeat = (beat >= 0);
+	ownership.beat		= (beat < 0) ? 0 : beat;
+	ownership.missed	= 0;
+	mutex_unlock(&ownership.lock);
+
+	blocking_notifier_call_chain(&ownership.notifier, state, NULL);
+	schedule_delayed_work(&ownership.work, 0);
+}
+
+static void omp800_cpld_ownership_stop(void)
+{
+	struct cpld_client_node *node;
+
+	cancel_delayed_work_sync(&ownership.work);
+
+	mutex_lock(&ownership.lock);
+	node = ownership.node;
+	ownership.node	= NULL;
+	ownership.state = OWNER_NONE;
+	mutex_unlock(&ownership.lock);
+
+	if (node) {
+		blocking_notifier_call_chain(&ownership.notifier, OWNER_NONE, NULL);
+		omp800_cpld_put_node(node);
+	}
+}
+
+static ssize_t show_ownership(struct device *dev, struct device_attribute *da,
+			 char *buf)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	ssize_t len;
+
+	mutex_lock(&ownership.lock);
+
+	if (attr->index == OWNER_INTERVAL) {
+		len = sprintf(buf, "%u\n", ownership.interval);
+	}
+	else {
+		len = sprintf(buf, "%s %u\n", (ownership.state == OWNER_ACTIVE) ? "active" : "standby",
+					  ownership.takeovers);
 	}
 
-	return count;
+	mutex_unlock(&ownership.lock);
+	return len;
 }
 
-static ssize_t show_cpu_mac_reset(struct device *dev, struct device_attribute *da,
-			 char *buf)
+static ssize_t set_ownership_interval(struct device *dev, struct device_attribute *da,
+			const char *buf, size_t count)
 {
-	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
-	struct i2c_client *client = to_i2c_client(dev);
-	int status, mask = 0;
+	unsigned int interval;
+	int error;
 
-	/* Read reset status */
-	status = i2c_smbus_read_byte_data(client, 0x8);
-	if (unlikely(status < 0)) {
-		return status;
+	error = kstrtouint(buf, 10, &interval);
+	if (error) {
+		return error;
 	}
-	
-	switch (attr->index) {
-		case RESET_CPU_A:
-			mask = 0x1;
-			break;
-		case RESET_CPU_B:
-			mask = 0x10;
-			break;
-		case RESET_MAC_A:
-			mask = 0x2;
-			break;
-		case RESET_MAC_B:
-			mask = 0x20;
-			break;
-		default:
-			break;
+
+	if (interval < 100 || interval > 10000) {
+		return -EINVAL;
 	}
 
-	return sprintf(buf, "%d\n", !(status & mask));
+	mutex_lock(&ownership.lock);
+	ownership.interval = interval;
+	mutex_unlock(&ownership.lock);
+
+	return count;
 }
 
 static SENSOR_DEVICE_ATTR(version, S_IRUGO, show_data, NULL, VERSION);
@@ -332,6 +1896,17 @@ static SENSOR_DEVICE_ATTR(card_slot_id, S_IRUGO, show_data, NULL, CARD_SLOT_ID);
 static SENSOR_DEVICE_ATTR(chassis_slot_id, S_IRUGO, show_data, NULL, CHASSIS_SLOT_ID);
 static SENSOR_DEVICE_ATTR(temp1_input, S_IWUSR | S_IRUGO, show_temp, set_temp, CPU_THERMAL);
 static SENSOR_DEVICE_ATTR(temp2_input, S_IWUSR | S_IRUGO, show_temp, set_temp, MAC_THERMAL);
+static SENSOR_DEVICE_ATTR(temp_feed_interval, S_IWUSR | S_IRUGO, show_temp_feed, set_temp_feed, TEMP_FEED_INTERVAL);
+static SENSOR_DEVICE_ATTR(temp_feed_cpu_zone, S_IWUSR | S_IRUGO, show_temp_feed, set_temp_feed, TEMP_FEED_CPU_ZONE);
+static SENSOR_DEVICE_ATTR(temp_feed_errors, S_IRUGO, show_temp_feed, NULL, TEMP_FEED_ERRORS);
+static SENSOR_DEVICE_ATTR(chassis_inventory, S_IRUGO, show_inventory, NULL, CHASSIS_INVENTORY);
+static SENSOR_DEVICE_ATTR(inventory_interval, S_IWUSR | S_IRUGO, show_inventory, set_inventory_interval, INVENTORY_INTERVAL);
+static SENSOR_DEVICE_ATTR(chassis_reset, S_IWUSR | S_IRUGO, show_chassis_reset, set_chassis_reset, CHASSIS_RESET);
+static SENSOR_DEVICE_ATTR(chassis_reset_pulse, S_IWUSR | S_IRUGO, show_chassis_reset, set_chassis_reset, CHASSIS_RESET_PULSE);
+static SENSOR_DEVICE_ATTR(owner_state, S_IRUGO, show_ownership, NULL, OWNER_STATE);
+static SENSOR_DEVICE_ATTR(owner_interval, S_IWUSR | S_IRUGO, show_ownership, set_ownership_interval, OWNER_INTERVAL);
+static SENSOR_DEVICE_ATTR(present_status, S_IRUGO, show_present_status, NULL, PRESENT_STATUS);
+static SENSOR_DEVICE_ATTR(poll_interval, S_IWUSR | S_IRUGO, show_poll_interval, set_poll_interval, POLL_INTERVAL);
 static SENSOR_DEVICE_ATTR(reset_cpu_a, S_IWUSR | S_IRUGO, show_cpu_mac_reset, set_cpu_mac_reset, RESET_CPU_A);
 static SENSOR_DEVICE_ATTR(reset_cpu_b, S_IWUSR | S_IRUGO, show_cpu_mac_reset, set_cpu_mac_reset, RESET_CPU_B);
 static SENSOR_DEVICE_ATTR(reset_mac_a, S_IWUSR | S_IRUGO, show_cpu_mac_reset, set_cpu_mac_reset, RESET_MAC_A);
@@ -345,6 +1920,21 @@ static struct attribute *cpld1_attr[] = {
 	&sensor_dev_attr_chassis_slot_id.dev_attr.attr,
 	&sensor_dev_attr_temp1_input.dev_attr.attr,
 	&sensor_dev_attr_temp2_input.dev_attr.attr,
+	&sensor_dev_attr_temp_feed_interval.dev_attr.attr,
+	&sensor_dev_attr_temp_feed_cpu_zone.dev_attr.attr,
+	&sensor_dev_attr_temp_feed_errors.dev_attr.attr,
+	&sensor_dev_attr_present_status.dev_attr.attr,
+	&sensor_dev_attr_poll_interval.dev_attr.attr,
+	NULL
+};
+
+static struct attribute *cpld1_fc_attr[] = {
+	&sensor_dev_attr_chassis_inventory.dev_attr.attr,
+	&sensor_dev_attr_inventory_interval.dev_attr.attr,
+	&sensor_dev_attr_chassis_reset.dev_attr.attr,
+	&sensor_dev_attr_chassis_reset_pulse.dev_attr.attr,
+	&sensor_dev_attr_owner_state.dev_attr.attr,
+	&sensor_dev_attr_owner_interval.dev_attr.attr,
 	NULL
 };
 
@@ -358,13 +1948,110 @@ static struct attribute *cpld_remote_attr[] = {
 	&sensor_dev_attr_reset_cpu_b.dev_attr.attr,
 	&sensor_dev_attr_reset_mac_a.dev_attr.attr,
 	&sensor_dev_attr_reset_mac_b.dev_attr.attr,
+	&sensor_dev_attr_poll_interval.dev_attr.attr,
 	NULL
 };
 
+static struct omp800_cpld_data *omp800_cpld_kobj_to_data(struct kobject *kobj)
+{
+	struct device *dev = container_of(kobj, struct device, kobj);
+
+	return i2c_get_clientdata(to_i2c_client(dev));
+}
+
+static ssize_t omp800_cpld_regs_read(struct file *filp, struct kobject *kobj,
+									 struct bin_attribute *attr,
+									 char *buf, loff_t off, size_t count)
+{
+	struct omp800_cpld_data *data = omp800_cpld_kobj_to_data(kobj);
+	const struct regmap_access_table *table = &data->regs_window->rd_table;
+	unsigned int reg, last, len;
+	int i, status;
+
+	memset(buf, 0xFF, count);
+
+	for (i = 0; i < table->n_yes_ranges; i++) {
+		reg	 = max_t(unsigned int, table->yes_ranges[i].range_min, off);
+		last = min_t(unsigned int, table->yes_ranges[i].range_max, off + count - 1);
+
+		while (reg <= last) {
+			len = min_t(unsigned int, last - reg + 1, OMP800_CPLD_BLOCK_MAX);
+
+			status = omp800_cpld_node_read_block(data->node, reg, len, (u8 *)buf + (reg - off));
+			if (status < 0) {
+				return status;
+			}
+
+			reg += len;
+		}
+	}
+
+	return count;
+}
+
+static ssize_t omp800_cpld_regs_write(struct file *filp, struct kobject *kobj,
+									  struct bin_attribute *attr,
+									  char *buf, loff_t off, size_t count)
+{
+	struct omp800_cpld_data *data = omp800_cpld_kobj_to_data(kobj);
+	const struct regmap_access_table *table = &data->regs_window->wr_table;
+	unsigned int reg;
+	size_t done = 0;
+	int i, status;
+
+	for (reg = off; reg < off + count; reg++) {
+		if (!omp800_cpld_reg_in_table(table, reg)) {
+			return -EPERM;
+		}
+	}
+
+	/* Raw writes to the temperature registers go around set_temp, drop
+	 * what the feeder last wrote so its next run writes them again.
+	 */
+	mutex_lock(&data->update_lock);
+
+	for (i = 0; i < ARRAY_SIZE(temp_regs); i++) {
+		if (temp_regs[i] >= off && temp_regs[i] < off + count) {
+			data->temp_input[i] = (s8)buf[temp_regs[i] - off];
+			data->temp_fed_valid &= ~BIT(i);
+		}
+	}
+
+	while (done < count) {
+		status = omp800_cpld_node_write_block(data->node, off + done,
+											  min_t(size_t, count - done, OMP800_CPLD_BLOCK_MAX),
+											  (u8 *)buf + done);
+		if (status < 0) {
+			mutex_unlock(&data->update_lock);
+			return status;
+		}
+
+		done += status;
+	}
+
+	mutex_unlock(&data->update_lock);
+
+	return count;
+}
+
+static struct bin_attribute cpld_regs_attr = {
+	.attr = {
+		.name = "regs",
+		.mode = S_IWUSR | S_IRUGO,
+	},
+	.size  = OMP800_CPLD_MAX_REGISTER + 1,
+	.read  = omp800_cpld_regs_read,
+	.write = omp800_cpld_regs_write,
+};
+
 static const struct attribute_group cpld1_group = {
 	.attrs = cpld1_attr,
 };
 
+static const struct attribute_group cpld1_fc_group = {
+	.attrs = cpld1_fc_attr,
+};
+
 static const struct attribute_group cpld2_group = {
 	.attrs = cpld2_attr,
 };
@@ -379,6 +2066,20 @@ omp800_cpld2,
 omp800_cpld_remote
 };
 
+/* Stop the temp feed and status poll workers; both log through
+ * data->hwmon_dev, so this must run before it is unregistered.
+ */
+static void omp800_cpld_stop_workers(struct omp800_cpld_data *data)
+{
+	mutex_lock(&data->update_lock);
+	data->temp_feed_interval = 0;
+	data->poll_interval = 0;
+	mutex_unlock(&data->update_lock);
+
+	cancel_delayed_work_sync(&data->temp_feed_work);
+	cancel_delayed_work_sync(&data->poll_work);
+}
+
 static int omp800_cpld_probe(struct i2c_client *client,
 			const struct i2c_device_id *dev_id)
 {
@@ -396,14 +2097,23 @@ static int omp800_cpld_probe(struct i2c_client *client,
 		return -ENOMEM;
 	}
 
+	data->node = omp800_cpld_alloc_node(client, (dev_id->driver_data == omp800_cpld_remote) ?
+										&omp800_cpld_remote_regmap_config : &omp800_cpld_regmap_config);
+	if (IS_ERR(data->node)) {
+		return PTR_ERR(data->node);
+	}
+
 	i2c_set_clientdata(client, data);
 	data->slot_id = -1;
 	data->version = -1;
 	mutex_init(&data->update_lock);
+	INIT_DELAYED_WORK(&data->temp_feed_work, omp800_cpld_temp_feed);
+	INIT_DELAYED_WORK(&data->poll_work, omp800_cpld_poll);
+	strscpy(data->temp_feed_zone, TEMP_FEED_DEFAULT_CPU_ZONE, sizeof(data->temp_feed_zone));
 
 	/* Get card type */
 	if (dev_id->driver_data == omp800_cpld1) {
-		status = i2c_smbus_read_byte_data(client, 0x2);
+		status = omp800_cpld_node_read(data->node, 0x2);
 
 		if (status < 0) {
 			dev_dbg(&client->dev, "reg %d, err %d\n", 0x2, status);
@@ -412,28 +2122,35 @@ static int omp800_cpld_probe(struct i2c_client *client,
 
 		card_type = omp800_is_linecard(status) ? CT_LINECARD : CT_FABRICCARD;
 		group = &cpld1_group;
+		data->poll = &cpld1_poll;
+		data->regs_window = &cpld1_regs_window;
 		data->slot_id = status;
 	}
 	else if (dev_id->driver_data == omp800_cpld2) {
 		DEBUG_PRINT("Card Type = (%d)", card_type);
 		if (card_type != CT_LINECARD) {
-			return -ENXIO;
+			status = -ENXIO;
+			goto exit_free;
 		}
 
 		group = &cpld2_group;
+		data->regs_window = &cpld2_regs_window;
 	}
 	else if (dev_id->driver_data == omp800_cpld_remote) {
 		group = &cpld_remote_group;
+		data->poll = &cpld_remote_poll;
+		data->regs_window = &cpld_remote_regs_window;
 	}
 	else {
-		return -ENXIO;
+		status = -ENXIO;
+		goto exit_free;
 	}
 
 	data->driver_type = dev_id->driver_data;
 
 	if (dev_id->driver_data == omp800_cpld1 || dev_id->driver_data == omp800_cpld2) {
 		/* Get version information */
-		status = i2c_smbus_read_byte_data(client, 0x1);
+		status = omp800_cpld_node_read(data->node, 0x1);
 		if (status < 0) {
 			dev_dbg(&client->dev, "reg %d, err %d\n", 0x1, status);
 			goto exit_free;
@@ -446,24 +2163,65 @@ static int omp800_cpld_probe(struct i2c_client *client,
 		goto exit_free;
 	}
 
+	status = sysfs_create_bin_file(&client->dev.kobj, &cpld_regs_attr);
+	if (status) {
+		goto exit_remove;
+	}
+
 	data->hwmon_dev = hwmon_device_register(&client->dev);
 	if (IS_ERR(data->hwmon_dev)) {
 		status = PTR_ERR(data->hwmon_dev);
-		goto exit_remove;
+		goto exit_remove_bin;
+	}
+
+	if (dev_id->driver_data == omp800_cpld1 && card_type == CT_FABRICCARD) {
+		status = sysfs_create_group(&client->dev.kobj, &cpld1_fc_group);
+		if (status) {
+			goto exit_unregister;
+		}
+
+		if (inventory.interval) {
+			schedule_delayed_work(&inventory.work, 0);
+		}
+	}
+
+	if (data->poll && data->poll->interval) {
+		data->poll_interval = data->poll->interval;
+		schedule_delayed_work(&data->poll_work, 0);
 	}
 
 	dev_info(&client->dev, "chip found\n");
 	
 	if (dev_id->driver_data == omp800_cpld1 || dev_id->driver_data == omp800_cpld2) {
-		omp800_cpld_add_client(client);
+		omp800_cpld_add_client(cpld_clients, data->node);
+	}
+	else {
+		omp800_cpld_add_client(remote_cpld_clients, data->node);
+	}
+
+	if (dev_id->driver_data == omp800_cpld1) {
+		mutex_lock(&cpld1_lock);
+		cpld1_data = data;
+		mutex_unlock(&cpld1_lock);
+	}
+
+	if (dev_id->driver_data == omp800_cpld1 && card_type == CT_FABRICCARD) {
+		omp800_cpld_ownership_start(data->node, (data->slot_id & 0x80) ? 1 : 0);
 	}
 	
 	return 0;
 
+exit_unregister:
+	omp800_cpld_stop_workers(data);
+	hwmon_device_unregister(data->hwmon_dev);
+exit_remove_bin:
+	sysfs_remove_bin_file(&client->dev.kobj, &cpld_regs_attr);
 exit_remove:
 	sysfs_remove_group(&client->dev.kobj, group);
+	omp800_cpld_stop_workers(data);
 exit_free:
-	kfree(data);
+	omp800_cpld_remove_client((dev_id->driver_data == omp800_cpld_remote) ?
+							  remote_cpld_clients : cpld_clients, data->node);
 	return status;
 }
 
@@ -471,10 +2229,24 @@ static int omp800_cpld_remove(struct i2c_client *client)
 {
 	struct omp800_cpld_data *data = i2c_get_clientdata(client);
 
+	if (data->driver_type == omp800_cpld1) {
+		mutex_lock(&cpld1_lock);
+		cpld1_data = NULL;
+		mutex_unlock(&cpld1_lock);
+	}
+
+	omp800_cpld_stop_workers(data);
 	hwmon_device_unregister(data->hwmon_dev);
+	sysfs_remove_bin_file(&client->dev.kobj, &cpld_regs_attr);
 
 	if (data->driver_type == omp800_cpld1) {
 		sysfs_remove_group(&client->dev.kobj, &cpld1_group);
+
+		if (card_type == CT_FABRICCARD) {
+			sysfs_remove_group(&client->dev.kobj, &cpld1_fc_group);
+			cancel_delayed_work_sync(&inventory.work);
+			omp800_cpld_ownership_stop();
+		}
 	}
 	else if (data->driver_type == omp800_cpld2) { /* omp800_cpld2 */
 		sysfs_remove_group(&client->dev.kobj, &cpld2_group);
@@ -482,10 +2254,10 @@ static int omp800_cpld_remove(struct i2c_client *client)
 	else if (data->driver_type == omp800_cpld_remote) {
 		sysfs_remove_group(&client->dev.kobj, &cpld_remote_group);
 	}
-	
-	kfree(data);
 
-	omp800_cpld_remove_client(client);
+	omp800_cpld_remove_client((data->driver_type == omp800_cpld_remote) ?
+							  remote_cpld_clients : cpld_clients, data->node);
+
 	return 0;
 }
 
@@ -509,23 +2281,15 @@ static struct i2c_driver omp800_cpld_driver = {
 
 int omp800_cpld_read(unsigned short cpld_addr, u8 reg)
 {
-	struct list_head   *list_node = NULL;
-	struct cpld_client_node *cpld_node = NULL;
-	int ret = -EPERM;
-	
-	mutex_lock(&list_lock);
+	struct cpld_client_node *node = omp800_cpld_get_node(cpld_addr);
+	int ret;
 
-	list_for_each(list_node, &cpld_client_list)
-	{
-		cpld_node = list_entry(list_node, struct cpld_client_node, list);
-		
-		if (cpld_node->client->addr == cpld_addr) {
-			ret = i2c_smbus_read_byte_data(cpld_node->client, reg);
-			break;
-		}
+	if (!node) {
+		return -EPERM;
 	}
-	
-	mutex_unlock(&list_lock);
+
+	ret = omp800_cpld_node_read(node, reg);
+	omp800_cpld_put_node(node);
 
 	return ret;
 }
@@ -533,31 +2297,296 @@ EXPORT_SYMBOL(omp800_cpld_read);
 
 int omp800_cpld_write(unsigned short cpld_addr, u8 reg, u8 value)
 {
-	struct list_head   *list_node = NULL;
-	struct cpld_client_node *cpld_node = NULL;
-	int ret = -EIO;
-	
-	mutex_lock(&list_lock);
+	struct cpld_client_node *node = omp800_cpld_get_node(cpld_addr);
+	int ret;
 
-	list_for_each(list_node, &cpld_client_list)
-	{
-		cpld_node = list_entry(list_node, struct cpld_client_node, list);
-		
-		if (cpld_node->client->addr == cpld_addr) {
-			ret = i2c_smbus_write_byte_data(cpld_node->client, reg, value);
-			break;
-		}
+	if (!node) {
+		return -EIO;
 	}
-	
-	mutex_unlock(&list_lock);
+
+	ret = omp800_cpld_node_write(node, reg, value);
+	omp800_cpld_put_node(node);
 
 	return ret;
 }
 EXPORT_SYMBOL(omp800_cpld_write);
 
+int omp800_cpld_read_block(unsigned short cpld_addr, u8 reg, u8 len, u8 *values)
+{
+	struct cpld_client_node *node = omp800_cpld_get_node(cpld_addr);
+	int ret;
+
+	if (!node) {
+		return -EPERM;
+	}
+
+	ret = omp800_cpld_node_read_block(node, reg, len, values);
+	omp800_cpld_put_node(node);
+
+	return ret;
+}
+EXPORT_SYMBOL(omp800_cpld_read_block);
+
+int omp800_cpld_write_block(unsigned short cpld_addr, u8 reg, u8 len, const u8 *values)
+{
+	struct cpld_client_node *node = omp800_cpld_get_node(cpld_addr);
+	int ret;
+
+	if (!node) {
+		return -EIO;
+	}
+
+	ret = omp800_cpld_node_write_block(node, reg, len, values);
+	omp800_cpld_put_node(node);
+
+	return ret;
+}
+EXPORT_SYMBOL(omp800_cpld_write_block);
+
+int omp800_cpld_read_regs(unsigned short cpld_addr, const u8 *regs, u8 *values, int num)
+{
+	struct cpld_client_node *node = omp800_cpld_get_node(cpld_addr);
+	int ret;
+
+	if (!node) {
+		return -EPERM;
+	}
+
+	ret = omp800_cpld_node_read_regs(node, regs, values, num);
+	omp800_cpld_put_node(node);
+
+	return ret;
+}
+EXPORT_SYMBOL(omp800_cpld_read_regs);
+
+int omp800_cpld_update_bits(unsigned short cpld_addr, u8 reg, u8 mask, u8 value)
+{
+	struct cpld_client_node *node = omp800_cpld_get_node(cpld_addr);
+	int ret;
+
+	if (!node) {
+		return -EIO;
+	}
+
+	ret = omp800_cpld_node_update_bits(node, reg, mask, value);
+	omp800_cpld_put_node(node);
+
+	return ret;
+}
+EXPORT_SYMBOL(omp800_cpld_update_bits);
+
+int omp800_cpld_read_async(unsigned short cpld_addr, u8 reg,
+						   void (*complete)(void *context, int status, u8 value),
+						   void *context)
+{
+	if (!complete) {
+		return -EINVAL;
+	}
+
+	return omp800_cpld_submit(cpld_addr, CPLD_ASYNC_READ, reg, 0, 0, complete, context);
+}
+EXPORT_SYMBOL(omp800_cpld_read_async);
+
+int omp800_cpld_write_async(unsigned short cpld_addr, u8 reg, u8 value,
+							void (*complete)(void *context, int status, u8 value),
+							void *context)
+{
+	return omp800_cpld_submit(cpld_addr, CPLD_ASYNC_WRITE, reg, 0, value, complete, context);
+}
+EXPORT_SYMBOL(omp800_cpld_write_async);
+
+int omp800_cpld_update_bits_async(unsigned short cpld_addr, u8 reg, u8 mask, u8 value,
+								  void (*complete)(void *context, int status, u8 value),
+								  void *context)
+{
+	return omp800_cpld_submit(cpld_addr, CPLD_ASYNC_UPDATE_BITS, reg, mask, value, complete, context);
+}
+EXPORT_SYMBOL(omp800_cpld_update_bits_async);
+
+/* Presence of the card behind a remote CPLD as of the last inventory
+ * refresh, -ENODEV if that is unknown (CPLD not instantiated, inventory
+ * disabled or not running on the fabric card).
+ */
+int omp800_cpld_remote_present(unsigned short cpld_addr)
+{
+	unsigned int index = cpld_addr - OMP800_CPLD_ADDR_BASE;
+	int ret = -ENODEV;
+
+	if (index >= OMP800_CPLD_ADDR_NUM) {
+		return -EINVAL;
+	}
+
+	mutex_lock(&inventory.lock);
+	if (card_type == CT_FABRICCARD && inventory.interval &&
+		inventory.slot[index].registered) {
+		ret = inventory.slot[index].present;
+	}
+	mutex_unlock(&inventory.lock);
+
+	return ret;
+}
+EXPORT_SYMBOL(omp800_cpld_remote_present);
+
+/* Hold or release CPU/MAC of the card behind a remote CPLD in reset, the
+ * component mask uses the reg 0x8 layout (CHASSIS_RESET_COMPONENT_MASK).
+ */
+int omp800_cpld_remote_reset(unsigned short cpld_addr, u8 component_mask, int assert)
+{
+	struct cpld_client_node *node;
+	int ret;
+
+	component_mask &= CHASSIS_RESET_COMPONENT_MASK;
+	if (!component_mask) {
+		return -EINVAL;
+	}
+
+	node = __omp800_cpld_get_node(remote_cpld_clients, cpld_addr);
+	if (!node) {
+		return -ENODEV;
+	}
+
+	/* Reset is active low */
+	ret = omp800_cpld_node_update_bits(node, 0x8, component_mask, assert ? 0 : component_mask);
+	omp800_cpld_put_node(node);
+
+	return ret;
+}
+EXPORT_SYMBOL(omp800_cpld_remote_reset);
+
+/* Card type and slot ids (reg 0x2) reported by a remote CPLD, read from
+ * the card itself so callers can check who they are about to act on.
+ */
+int omp800_cpld_remote_slot_id(unsigned short cpld_addr)
+{
+	struct cpld_client_node *node;
+	int ret;
+
+	node = __omp800_cpld_get_node(remote_cpld_clients, cpld_addr);
+	if (!node) {
+		return -ENODEV;
+	}
+
+	ret = omp800_cpld_node_read(node, 0x2);
+	omp800_cpld_put_node(node);
+
+	return ret;
+}
+EXPORT_SYMBOL(omp800_cpld_remote_slot_id);
+
+/* 1 if the card behind a remote CPLD is the one this CPU runs on, i.e. it
+ * reports the card type and slot ids (reg 0x2) of the local cpld1, 0 if
+ * not, < 0 if that is unknown.
+ */
+int omp800_cpld_remote_is_local(unsigned short cpld_addr)
+{
+	int local = -ENODEV, remote = omp800_cpld_remote_slot_id(cpld_addr);
+
+	if (remote < 0) {
+		return remote;
+	}
+
+	mutex_lock(&cpld1_lock);
+	if (cpld1_data) {
+		local = cpld1_data->slot_id;
+	}
+	mutex_unlock(&cpld1_lock);
+
+	if (local < 0) {
+		return local;
+	}
+
+	/* Card type, chassis slot id and card slot id */
+	return !((local ^ remote) & 0x1F);
+}
+EXPORT_SYMBOL(omp800_cpld_remote_is_local);
+
+/* Board presence register (0x48) of the local cpld1, served from the
+ * status poller sample while it runs so callers do not add bus traffic.
+ */
+int omp800_cpld_present_status(void)
+{
+	int ret = -ENODEV;
+
+	mutex_lock(&cpld1_lock);
+	if (cpld1_data) {
+		ret = omp800_cpld_read_status(cpld1_data, 0x48);
+	}
+	mutex_unlock(&cpld1_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL(omp800_cpld_present_status);
+
+/* 1 if this CPU owns the chassis fan/PDU control, 0 if it is on standby,
+ * -ENODEV if ownership is not tracked (not running on the fabric card).
+ * Changes are signalled through the owner notifier with the new
+ * omp800_owner_state.
+ */
+int omp800_cpld_is_owner(void)
+{
+	int ret;
+
+	mutex_lock(&ownership.lock);
+	ret = (ownership.state == OWNER_NONE) ? -ENODEV : (ownership.state == OWNER_ACTIVE);
+	mutex_unlock(&ownership.lock);
+
+	return ret;
+}
+EXPORT_SYMBOL(omp800_cpld_is_owner);
+
+int omp800_cpld_register_owner_notifier(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_register(&ownership.notifier, nb);
+}
+EXPORT_SYMBOL(omp800_cpld_register_owner_notifier);
+
+int omp800_cpld_unregister_owner_notifier(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_unregister(&ownership.notifier, nb);
+}
+EXPORT_SYMBOL(omp800_cpld_unregister_owner_notifier);
+
+int omp800_cpld_register_mac_temp(int (*get_temp)(void *priv, int *temp), void *priv)
+{
+	int ret = 0;
+
+	mutex_lock(&mac_temp_lock);
+	if (mac_temp_provider.get_temp) {
+		ret = -EBUSY;
+	}
+	else {
+		mac_temp_provider.get_temp = get_temp;
+		mac_temp_provider.priv	   = priv;
+	}
+	mutex_unlock(&mac_temp_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL(omp800_cpld_register_mac_temp);
+
+void omp800_cpld_unregister_mac_temp(void *priv)
+{
+	mutex_lock(&mac_temp_lock);
+	if (mac_temp_provider.priv == priv) {
+		mac_temp_provider.get_temp = NULL;
+		mac_temp_provider.priv	   = NULL;
+	}
+	mutex_unlock(&mac_temp_lock);
+}
+EXPORT_SYMBOL(omp800_cpld_unregister_mac_temp);
+
 static int __init omp800_cpld_init(void)
 {
-	mutex_init(&list_lock);
+	mutex_init(&inventory.lock);
+	INIT_DELAYED_WORK(&inventory.work, omp800_cpld_inventory_refresh);
+	inventory.interval = INVENTORY_DEFAULT_INTERVAL;
+	mutex_init(&chassis_reset.lock);
+	chassis_reset.pulse = CHASSIS_RESET_DEFAULT_PULSE;
+	mutex_init(&ownership.lock);
+	INIT_DELAYED_WORK(&ownership.work, omp800_cpld_ownership_check);
+	BLOCKING_INIT_NOTIFIER_HEAD(&ownership.notifier);
+	ownership.interval = OWNERSHIP_DEFAULT_INTERVAL;
+
 	return i2c_add_driver(&omp800_cpld_driver);
 }
 
@@ -26,6 +26,11 @@
 #include <linux/sysfs.h>
 #include <linux/slab.h>
 #include <linux/dmi.h>
+#include <linux/workqueue.h>
+#include <linux/string.h>
+#include <linux/thermal.h>
+#include <linux/list.h>
+#include <linux/notifier.h>
 
 #define DRVNAME "omp800_fc_fan"
 
@@ -39,10 +44,13 @@
 #endif
 
 #define NUM_OF_CARD				6
+#define NUM_OF_LINECARD			4	/* lc1 ~ lc4, then fc1 ~ fc2 */
 #define NUM_OF_THERMAL_PER_CARD 6
 #define NUM_OF_THERMAL_SENSORS  (NUM_OF_CARD * NUM_OF_THERMAL_PER_CARD)
+#define TEMP_CARD_REG(card)		(0x50 + ((card) << 4)) /* 6 contiguous sensors per card */
 
 static struct omp800_fc_fan_data *omp800_fc_fan_update_device(struct device *dev);
+static struct omp800_fc_fan_data *omp800_fc_fan_update_temp(struct device *dev);
 static ssize_t fan_show_enable(struct device *dev, struct device_attribute *da, char *buf);
 static ssize_t fan_set_enable(struct device *dev, struct device_attribute *da,
 			const char *buf, size_t count);
@@ -52,14 +60,63 @@ static ssize_t temp_show_warning(struct device *dev, struct device_attribute *da
 static ssize_t temp_show_shutdown(struct device *dev, struct device_attribute *da, char *buf);
 static ssize_t set_duty_cycle(struct device *dev, struct device_attribute *da,
 			const char *buf, size_t count);
+static ssize_t fan_show_control(struct device *dev, struct device_attribute *da, char *buf);
+static ssize_t fan_show_health(struct device *dev, struct device_attribute *da, char *buf);
+static ssize_t fan_set_health(struct device *dev, struct device_attribute *da,
+			const char *buf, size_t count);
+static ssize_t fan_show_chassis(struct device *dev, struct device_attribute *da, char *buf);
+static ssize_t fan_show_protect(struct device *dev, struct device_attribute *da, char *buf);
+static ssize_t fan_show_sample(struct device *dev, struct device_attribute *da, char *buf);
+static ssize_t fan_set_sample(struct device *dev, struct device_attribute *da,
+			const char *buf, size_t count);
+static ssize_t fan_set_protect(struct device *dev, struct device_attribute *da,
+			const char *buf, size_t count);
+static ssize_t fan_set_chassis_duty_cycle(struct device *dev, struct device_attribute *da,
+			const char *buf, size_t count);
+static ssize_t fan_set_control(struct device *dev, struct device_attribute *da,
+			const char *buf, size_t count);
 extern int omp800_cpld_read(unsigned short cpld_addr, u8 reg);
+extern int omp800_cpld_remote_present(unsigned short cpld_addr);
+extern int omp800_cpld_remote_reset(unsigned short cpld_addr, u8 component_mask, int assert);
+extern int omp800_cpld_remote_slot_id(unsigned short cpld_addr);
+extern int omp800_cpld_remote_is_local(unsigned short cpld_addr);
+extern int adm1278_set_hot_swap(int bus, unsigned short addr, int enable);
+extern int omp800_cpld_is_owner(void);
+extern int omp800_cpld_register_owner_notifier(struct notifier_block *nb);
+extern int omp800_cpld_unregister_owner_notifier(struct notifier_block *nb);
+
+/* Remote CPLD (i2c-6) of the card behind each thermal block, in the
+ * order of sysfs_fan_attributes (LC1 ~ LC4, FC1 ~ FC2). A card whose
+ * presence is unknown to the chassis inventory is always polled.
+ */
+static const unsigned short card_cpld_addr[NUM_OF_CARD] = {
+	0x65, 0x64, 0x67, 0x66, 0x60, 0x61
+};
+
+/* Targets of the reset and power-off protection, remote CPLD and ADM1278
+ * hot-swap controller (i2c-6) of each card, same order. The init script
+ * only lists these devices, not which card each one belongs to, so an
+ * action is refused for a card until the platform passes its address.
+ */
+#define CARD_HOTSWAP_BUS	6
+static ushort protect_cpld[NUM_OF_CARD];
+module_param_array(protect_cpld, ushort, NULL, S_IRUGO);
+MODULE_PARM_DESC(protect_cpld, "Remote CPLD of lc1 ~ lc4, fc1 ~ fc2 held in reset by thermal protection");
+
+static ushort protect_hotswap[NUM_OF_CARD];
+module_param_array(protect_hotswap, ushort, NULL, S_IRUGO);
+MODULE_PARM_DESC(protect_hotswap, "ADM1278 of lc1 ~ lc4, fc1 ~ fc2 powered off by thermal protection");
+
+static const char * const card_name[NUM_OF_CARD] = {
+	"lc1", "lc2", "lc3", "lc4", "fc1", "fc2"
+};
 
 /* fan related data, the index should match sysfs_fan_attributes
  */
 static const u8 fan_reg[] = {
 	0x0F,	   /* fan 1-4 present status */
-	0x11,	   /* fan PWM(for all fan) */
 	0x01,	   /* fan cpld version */
+	0x11,	   /* fan PWM(for all fan) */
 	0x12,	   /* front fan 1 speed(rpm) */
 	0x13,	   /* front fan 2 speed(rpm) */
 	0x14,	   /* front fan 3 speed(rpm) */
@@ -70,18 +127,195 @@ static const u8 fan_reg[] = {
 	0x25,	   /* rear fan 4 speed(rpm) */
 };
 
+/* Registers are sampled per class, each at its own interval. The version
+ * is static and only re-read after a failed refresh, i.e. when the fan
+ * board may have been replaced. Presence is also re-read as soon as a rotor
+ * starts or stops turning.
+ */
+enum fan_sample_class {
+	FAN_SAMPLE_PRESENT,
+	FAN_SAMPLE_SPEED,	/* Duty cycle and tach */
+	FAN_SAMPLE_NUM_CLASSES
+};
+
+#define FAN_SAMPLE_DEFAULT_PRESENT_INTERVAL 5000 /* ms */
+#define FAN_SAMPLE_DEFAULT_SPEED_INTERVAL	1500 /* ms */
+#define FAN_SAMPLE_DEFAULT_TEMP_INTERVAL	3000 /* ms */
+#define FAN_SAMPLE_GAP						2	 /* Unused registers read through to merge two blocks */
+
+/* Contiguous registers of one class, in register order. Due blocks close
+ * to each other are fetched with a single block read.
+ */
+struct fan_reg_block {
+	u8 index;	/* First index in fan_reg[] */
+	u8 len;
+	u8 class;	/* enum fan_sample_class */
+};
+
+static const struct fan_reg_block fan_reg_block[] = {
+	{ 0, 1, FAN_SAMPLE_PRESENT },	/* 0x0F */
+	{ 2, 5, FAN_SAMPLE_SPEED },		/* 0x11 ~ 0x15 */
+	{ 7, 4, FAN_SAMPLE_SPEED },		/* 0x22 ~ 0x25 */
+};
+
+/* Closed-loop fan control: the duty cycle follows a piecewise-linear curve
+ * of the hottest sensor class, x is the temperature relative to the
+ * warning degree of that class (in degree C), y the duty cycle.
+ */
+#define FAN_CURVE_MAX_POINTS		8
+#define FAN_CONTROL_DEFAULT_INTERVAL 3000 /* ms */
+#define FAN_CONTROL_HYSTERESIS		2000 /* m degree C, before slowing down */
+
+/* Duty writes are ramped in the background, ramp_up/ramp_down register
+ * steps (of 6.25%) at most every ramp_interval ms.
+ */
+#define FAN_DEFAULT_RAMP_UP			4
+#define FAN_DEFAULT_RAMP_DOWN		1
+#define FAN_DEFAULT_RAMP_INTERVAL	250 /* ms */
+
+enum fan_control_mode {
+	FAN_CONTROL_MANUAL,
+	FAN_CONTROL_AUTO
+};
+
+struct fan_curve_point {
+	s8 offset;
+	u8 duty;
+};
+
+static const struct fan_curve_point fan_default_curve[] = {
+	{ -15, 40 },
+	{  -5, 60 },
+	{	0, 80 },
+	{	5, 100 },
+};
+
+/* Fan health: every fan refresh is kept in a ring buffer. Each rotor's
+ * speed is compared with the nominal speed of its row (front or rear) at
+ * the commanded duty cycle, which also catches fans wearing out together,
+ * and with its peers in the same row. Both ratios (in permille) are
+ * smoothed with an EWMA. The front/rear balance of a fan is normalized by
+ * the row averages.
+ *
+ * The expected speed is taken as proportional to the duty cycle, from the
+ * speed at 100% duty. The fan module datasheet is not in this tree, so the
+ * nominal speed is unknown (0) until fan_nominal_rpm is written, only the
+ * peer comparison runs until then.
+ */
+#define NUM_OF_FAN					4
+#define NUM_OF_ROTOR				(NUM_OF_FAN * 2) /* Front 1 ~ 4, rear 1 ~ 4 */
+#define FAN_HEALTH_HISTORY			64
+#define FAN_HEALTH_EWMA_WEIGHT		8
+#define FAN_HEALTH_MAX_RATIO		2000
+#define FAN_HEALTH_IMBALANCE		200	 /* permille off the row balance */
+#define FAN_HEALTH_DEFAULT_INTERVAL 5000 /* ms */
+#define FAN_HEALTH_MAX_NOMINAL_RPM	25500 /* Tach register limit */
+
+/* Layout of the fan_health_history binary attribute, oldest first */
+struct fan_health_sample {
+	u32 msecs;				/* jiffies_to_msecs() at the refresh */
+	u8	duty;				/* Duty register */
+	u8	rpm[NUM_OF_ROTOR];	/* Tach registers, in 100 rpm */
+	u8	reserved[3];
+};
+
+/* Thermal shutdown protection, off by default. A sensor at or above its
+ * shutdown degree for protect_hold ms trips its card, the fans go to 100%
+ * at once (no ramp) and stay there until every sensor is back below its
+ * warning degree. The card can also be held in reset through its remote
+ * CPLD and/or powered off through its ADM1278, except the fabric card
+ * this CPU runs on.
+ */
+#define FAN_PROTECT_FANS			0x1
+#define FAN_PROTECT_RESET			0x2
+#define FAN_PROTECT_POWER_OFF		0x4
+#define FAN_PROTECT_MASK			0x7
+#define FAN_PROTECT_RESET_COMPONENT 0x33 /* CPU-A/B, MAC-A/B */
+#define FAN_PROTECT_DEFAULT_HOLD	6000 /* ms */
+#define FAN_PROTECT_MAX_HOLD		60000 /* ms */
+#define FAN_PROTECT_INTERVAL		3000 /* ms, one thermal sweep */
+
+/* Both fan boards of the chassis, for the chassis_fan_* attributes which
+ * are served from the cached snapshot of each board. Lock order is
+ * fan_boards_lock, then update_lock of a board.
+ */
+static LIST_HEAD(fan_boards);
+static DEFINE_MUTEX(fan_boards_lock);
+
+/* One thermal zone per card sensor, trips from the warning/shutdown tables */
+#define FAN_TZ_PASSIVE_DELAY	1000 /* ms */
+#define FAN_TZ_POLLING_DELAY	3000 /* ms */
+
+enum fan_tz_trip {
+	FAN_TZ_TRIP_PASSIVE,
+	FAN_TZ_TRIP_CRITICAL,
+	FAN_TZ_NUM_TRIPS
+};
+
+struct fan_thermal_zone {
+	struct omp800_fc_fan_data *data;
+	int index;		/* Index in temp_reg_val[] */
+	struct thermal_zone_device *tzd;
+};
+
 /* Each client has this additional data */
 struct omp800_fc_fan_data {
+	struct list_head list;			/* In fan_boards */
+	struct i2c_client *client;
+	struct notifier_block owner_nb;	/* Follow the fan/PDU control ownership */
+	struct fan_dyn_attr *dyn;		/* Per fan/sensor attributes */
+	struct attribute **dyn_attrs;
+	struct attribute_group dyn_group;
+	struct work_struct dyn_work;	/* Refresh the visibility of dyn_group */
+	u8				 dyn_dead;		/* != 0 once dyn_group is going away */
+	u8				 fan_hidden;	/* bit n != 0 if fan n is known absent */
+	u8				 card_hidden;	/* bit n != 0 if card n is known absent */
 	struct device   *hwmon_dev;
 	struct mutex	 update_lock;
 	u8				 enable;	   /* Enable or Disable fan board i2c access */
 	char			 valid;		   /* != 0 if registers are valid */
-	unsigned long	 last_updated;	/* In jiffies */
+	unsigned long	 sample_updated[FAN_SAMPLE_NUM_CLASSES];	/* In jiffies */
+	unsigned int	 sample_interval[FAN_SAMPLE_NUM_CLASSES];	/* In ms */
 	u8			     reg_val[ARRAY_SIZE(fan_reg)]; /* Register value */
 	struct mutex	 temp_update_lock;
 	unsigned long	 temp_last_updated;	/* In jiffies */
+	unsigned int	 temp_interval;		/* In ms */
 	u8				 temp_valid;	  /* != 0 if registers are valid */
+	u8				 temp_present;	  /* bit n != 0 if card n was polled */
 	u8				 temp_reg_val[NUM_OF_THERMAL_SENSORS]; /* Thermal sensor */
+	struct delayed_work control_work;
+	u8				 control_mode;		/* enum fan_control_mode */
+	unsigned int	 control_interval;	/* In ms */
+	u8				 num_points;
+	struct fan_curve_point curve[FAN_CURVE_MAX_POINTS];
+	u8				 duty_reg;		/* Duty register last written, 0xFF if unknown */
+	u8				 duty_target;	/* Duty requested by manual/auto control, 0xFF if none */
+	u8				 duty_goal;		/* Where the ramp is heading, 0xFF if nowhere */
+	u8				 watchdog_off;	/* != 0 once the fan speed watchdog is disabled */
+	struct delayed_work duty_work;	/* Ramp the duty register toward duty_goal */
+	unsigned long	 duty_last_write;	/* In jiffies */
+	u8				 ramp_up;		/* Register steps per write, 0 = no ramp */
+	u8				 ramp_down;
+	unsigned int	 ramp_interval;	/* In ms, minimum time between two writes */
+	u8				 cooling_state;	/* Floor of the duty register set by the thermal core */
+	struct thermal_cooling_device *cdev;
+	struct fan_thermal_zone zones[NUM_OF_THERMAL_SENSORS];
+	struct delayed_work health_work;	/* Refresh the fans periodically */
+	unsigned int	 health_interval;	/* In ms, 0 = only refresh on read */
+	unsigned int	 history_head;		/* Next sample to write */
+	unsigned int	 history_count;
+	struct fan_health_sample history[FAN_HEALTH_HISTORY];
+	u32				 nominal_rpm[2];		/* Front/rear speed at 100% duty, 0 = unknown */
+	int				 health[NUM_OF_ROTOR];	/* EWMA of speed vs nominal, permille */
+	int				 peer_health[NUM_OF_ROTOR];	/* EWMA of speed vs peers, permille */
+	int				 balance[NUM_OF_FAN];	/* EWMA of front/rear balance, permille */
+	struct delayed_work protect_work;	/* Sweep while protection is on */
+	u8				 protect;			/* FAN_PROTECT_*, 0 = off */
+	unsigned int	 protect_hold;		/* In ms over the shutdown degree */
+	u8				 protect_tripped;	/* bit n != 0 if card n tripped */
+	DECLARE_BITMAP(protect_over, NUM_OF_THERMAL_SENSORS);	/* Over the shutdown degree */
+	unsigned long	 protect_over_since[NUM_OF_THERMAL_SENSORS];	/* In jiffies */
+	u8				 protect_active;	/* != 0 while fans are forced to 100% */
 };
 
 /* CPU: >0x40, MAC: >0x52, LM75a: >0x3C, LM75b: >0x41, LM75c: >0x45, LM75d: >0x3E
@@ -163,8 +397,8 @@ FC##FCID##_TEMP6_SHUTDOWN
 
 enum sysfs_fan_attributes {
 	FAN_PRESENT_REG,
-	FAN_DUTY_CYCLE_PERCENTAGE, /* Only one CPLD register to control duty cycle for all fans */
 	FAN_VERSION,
+	FAN_DUTY_CYCLE_PERCENTAGE, /* Only one CPLD register to control duty cycle for all fans */
 	/*FAN_DIRECTION,*/
 	FAN1_FRONT_SPEED_RPM,
 	FAN2_FRONT_SPEED_RPM,
@@ -184,6 +418,32 @@ enum sysfs_fan_attributes {
 	FAN2_FAULT,
 	FAN3_FAULT,
 	FAN4_FAULT,
+	FAN1_HEALTH,
+	FAN2_HEALTH,
+	FAN3_HEALTH,
+	FAN4_HEALTH,
+	FAN1_IMBALANCE,
+	FAN2_IMBALANCE,
+	FAN3_IMBALANCE,
+	FAN4_IMBALANCE,
+	FAN_HEALTH_INTERVAL,
+	FAN_NOMINAL_RPM,
+	FAN_PRESENT_INTERVAL,
+	FAN_SPEED_INTERVAL,
+	TEMP_INTERVAL,
+	THERMAL_PROTECT,
+	THERMAL_PROTECT_HOLD,
+	CHASSIS_FAN_TOTAL_RPM,
+	CHASSIS_FAN_MIN_RPM,
+	CHASSIS_FAN_FAULT,
+	CHASSIS_FAN_PRESENT,
+	CHASSIS_FAN_DUTY_CYCLE_PERCENTAGE,
+	FAN_CONTROL_MODE,
+	FAN_CONTROL_CURVE,
+	FAN_CONTROL_INTERVAL,
+	FAN_DUTY_RAMP_UP,
+	FAN_DUTY_RAMP_DOWN,
+	FAN_DUTY_RAMP_INTERVAL,
 	LINECARD_TEMP_INPUT(1),   	/* Line card 0/4 temp input */
 	LINECARD_TEMP_INPUT(2),   	/* Line card 1/5 temp input */
 	LINECARD_TEMP_INPUT(3),   	/* Line card 2/7 temp input */
@@ -211,14 +471,24 @@ enum sysfs_fan_attributes {
  */
 static SENSOR_DEVICE_ATTR(fan_enable, S_IWUSR | S_IRUGO, fan_show_enable, fan_set_enable, FAN_ENABLE);
 static SENSOR_DEVICE_ATTR(fan_version, S_IRUGO, fan_show_value, NULL, FAN_VERSION);
-
-#define DECLARE_FAN_FAULT_SENSOR_DEV_ATTR(index) \
-	static SENSOR_DEVICE_ATTR(fan##index##_fault, S_IRUGO, fan_show_value, NULL, FAN##index##_FAULT)
-#define DECLARE_FAN_FAULT_ATTR(index)	  &sensor_dev_attr_fan##index##_fault.dev_attr.attr
-
-#define DECLARE_FAN_DIRECTION_SENSOR_DEV_ATTR(index) \
-	static SENSOR_DEVICE_ATTR(fan##index##_direction, S_IRUGO, fan_show_value, NULL, FAN##index##_DIRECTION)
-#define DECLARE_FAN_DIRECTION_ATTR(index)  &sensor_dev_attr_fan##index##_direction.dev_attr.attr
+static SENSOR_DEVICE_ATTR(fan_health_interval, S_IWUSR | S_IRUGO, fan_show_health, fan_set_health, FAN_HEALTH_INTERVAL);
+static SENSOR_DEVICE_ATTR(fan_nominal_rpm, S_IWUSR | S_IRUGO, fan_show_health, fan_set_health, FAN_NOMINAL_RPM);
+static SENSOR_DEVICE_ATTR(fan_present_interval, S_IWUSR | S_IRUGO, fan_show_sample, fan_set_sample, FAN_PRESENT_INTERVAL);
+static SENSOR_DEVICE_ATTR(fan_speed_interval, S_IWUSR | S_IRUGO, fan_show_sample, fan_set_sample, FAN_SPEED_INTERVAL);
+static SENSOR_DEVICE_ATTR(temp_interval, S_IWUSR | S_IRUGO, fan_show_sample, fan_set_sample, TEMP_INTERVAL);
+static SENSOR_DEVICE_ATTR(thermal_protect, S_IWUSR | S_IRUGO, fan_show_protect, fan_set_protect, THERMAL_PROTECT);
+static SENSOR_DEVICE_ATTR(thermal_protect_hold, S_IWUSR | S_IRUGO, fan_show_protect, fan_set_protect, THERMAL_PROTECT_HOLD);
+static SENSOR_DEVICE_ATTR(chassis_fan_total_rpm, S_IRUGO, fan_show_chassis, NULL, CHASSIS_FAN_TOTAL_RPM);
+static SENSOR_DEVICE_ATTR(chassis_fan_min_rpm, S_IRUGO, fan_show_chassis, NULL, CHASSIS_FAN_MIN_RPM);
+static SENSOR_DEVICE_ATTR(chassis_fan_fault, S_IRUGO, fan_show_chassis, NULL, CHASSIS_FAN_FAULT);
+static SENSOR_DEVICE_ATTR(chassis_fan_present, S_IRUGO, fan_show_chassis, NULL, CHASSIS_FAN_PRESENT);
+static SENSOR_DEVICE_ATTR(chassis_fan_duty_cycle_percentage, S_IWUSR | S_IRUGO, fan_show_chassis, fan_set_chassis_duty_cycle, CHASSIS_FAN_DUTY_CYCLE_PERCENTAGE);
+static SENSOR_DEVICE_ATTR(fan_control_mode, S_IWUSR | S_IRUGO, fan_show_control, fan_set_control, FAN_CONTROL_MODE);
+static SENSOR_DEVICE_ATTR(fan_control_curve, S_IWUSR | S_IRUGO, fan_show_control, fan_set_control, FAN_CONTROL_CURVE);
+static SENSOR_DEVICE_ATTR(fan_control_interval, S_IWUSR | S_IRUGO, fan_show_control, fan_set_control, FAN_CONTROL_INTERVAL);
+static SENSOR_DEVICE_ATTR(fan_duty_ramp_up, S_IWUSR | S_IRUGO, fan_show_control, fan_set_control, FAN_DUTY_RAMP_UP);
+static SENSOR_DEVICE_ATTR(fan_duty_ramp_down, S_IWUSR | S_IRUGO, fan_show_control, fan_set_control, FAN_DUTY_RAMP_DOWN);
+static SENSOR_DEVICE_ATTR(fan_duty_ramp_interval, S_IWUSR | S_IRUGO, fan_show_control, fan_set_control, FAN_DUTY_RAMP_INTERVAL);
 
 #define DECLARE_FAN_DUTY_CYCLE_SENSOR_DEV_ATTR(index) \
 	static SENSOR_DEVICE_ATTR(fan##index##_duty_cycle_percentage, S_IWUSR | S_IRUGO, fan_show_value, set_duty_cycle, FAN##index##_DUTY_CYCLE_PERCENTAGE)
@@ -228,123 +498,82 @@ static SENSOR_DEVICE_ATTR(fan_version, S_IRUGO, fan_show_value, NULL, FAN_VERSIO
 	static SENSOR_DEVICE_ATTR(fan##index##_present, S_IRUGO, fan_show_value, NULL, FAN##index##_PRESENT)
 #define DECLARE_FAN_PRESENT_ATTR(index)	  &sensor_dev_attr_fan##index##_present.dev_attr.attr
 
-#define DECLARE_FAN_SPEED_RPM_SENSOR_DEV_ATTR(index) \
-	static SENSOR_DEVICE_ATTR(fan##index##_front_speed_rpm, S_IRUGO, fan_show_value, NULL, FAN##index##_FRONT_SPEED_RPM);\
-	static SENSOR_DEVICE_ATTR(fan##index##_rear_speed_rpm, S_IRUGO, fan_show_value, NULL, FAN##index##_REAR_SPEED_RPM)
-#define DECLARE_FAN_SPEED_RPM_ATTR(index)  &sensor_dev_attr_fan##index##_front_speed_rpm.dev_attr.attr, \
-										   &sensor_dev_attr_fan##index##_rear_speed_rpm.dev_attr.attr
-
-/* lc[0-3]_temp[1-6]_input */
-#define DECLARE_LC_THERMAL_SENSOR_DEV_ATTR(lcid, tid) \
-	static SENSOR_DEVICE_ATTR(lc##lcid##_temp##tid##_input, S_IRUGO, temp_show_value, NULL, LC##lcid##_TEMP##tid##_INPUT);\
-	static SENSOR_DEVICE_ATTR(lc##lcid##_temp##tid##_warning, S_IRUGO, temp_show_warning, NULL, LC##lcid##_TEMP##tid##_WARNING);\
-	static SENSOR_DEVICE_ATTR(lc##lcid##_temp##tid##_shutdown, S_IRUGO, temp_show_shutdown, NULL, LC##lcid##_TEMP##tid##_SHUTDOWN)
-
-#define DECLARE_LC_THERMAL_SENSOR_DEV_ATTRS(lcid) 	\
-	DECLARE_LC_THERMAL_SENSOR_DEV_ATTR(lcid, 1);	\
-	DECLARE_LC_THERMAL_SENSOR_DEV_ATTR(lcid, 2);	\
-	DECLARE_LC_THERMAL_SENSOR_DEV_ATTR(lcid, 3);	\
-	DECLARE_LC_THERMAL_SENSOR_DEV_ATTR(lcid, 4);	\
-	DECLARE_LC_THERMAL_SENSOR_DEV_ATTR(lcid, 5);	\
-	DECLARE_LC_THERMAL_SENSOR_DEV_ATTR(lcid, 6)
-
-#define DECLARE_LC_THERMAL_SENSOR_ATTR(lcid, tid)					\
-	&sensor_dev_attr_lc##lcid##_temp##tid##_input.dev_attr.attr, 	\
-	&sensor_dev_attr_lc##lcid##_temp##tid##_warning.dev_attr.attr,	\
-	&sensor_dev_attr_lc##lcid##_temp##tid##_shutdown.dev_attr.attr
-#define DECLARE_LC_THERMAL_SENSOR_ATTRS(lcid)	\
-	DECLARE_LC_THERMAL_SENSOR_ATTR(lcid, 1),	\
-	DECLARE_LC_THERMAL_SENSOR_ATTR(lcid, 2),	\
-	DECLARE_LC_THERMAL_SENSOR_ATTR(lcid, 3),	\
-	DECLARE_LC_THERMAL_SENSOR_ATTR(lcid, 4),	\
-	DECLARE_LC_THERMAL_SENSOR_ATTR(lcid, 5),	\
-	DECLARE_LC_THERMAL_SENSOR_ATTR(lcid, 6)
-
-/* fc[0-1]_temp[1-6]_input */
-#define DECLARE_FC_THERMAL_SENSOR_DEV_ATTR(fcid, tid)	\
-	static SENSOR_DEVICE_ATTR(fc##fcid##_temp##tid##_input, S_IRUGO, temp_show_value, NULL, FC##fcid##_TEMP##tid##_INPUT);\
-	static SENSOR_DEVICE_ATTR(fc##fcid##_temp##tid##_warning, S_IRUGO, temp_show_warning, NULL, FC##fcid##_TEMP##tid##_WARNING);\
-	static SENSOR_DEVICE_ATTR(fc##fcid##_temp##tid##_shutdown, S_IRUGO, temp_show_shutdown, NULL, FC##fcid##_TEMP##tid##_SHUTDOWN)
-
-#define DECLARE_FC_THERMAL_SENSOR_DEV_ATTRS(fcid)	\
-	DECLARE_FC_THERMAL_SENSOR_DEV_ATTR(fcid, 1);	\
-	DECLARE_FC_THERMAL_SENSOR_DEV_ATTR(fcid, 2);	\
-	DECLARE_FC_THERMAL_SENSOR_DEV_ATTR(fcid, 3);	\
-	DECLARE_FC_THERMAL_SENSOR_DEV_ATTR(fcid, 4);	\
-	DECLARE_FC_THERMAL_SENSOR_DEV_ATTR(fcid, 5);	\
-	DECLARE_FC_THERMAL_SENSOR_DEV_ATTR(fcid, 6)
-
-#define DECLARE_FC_THERMAL_SENSOR_ATTR(fcid, tid)					\
-	&sensor_dev_attr_fc##fcid##_temp##tid##_input.dev_attr.attr, 	\
-	&sensor_dev_attr_fc##fcid##_temp##tid##_warning.dev_attr.attr,	\
-	&sensor_dev_attr_fc##fcid##_temp##tid##_shutdown.dev_attr.attr
-#define DECLARE_FC_THERMAL_SENSOR_ATTRS(fcid)	\
-	DECLARE_FC_THERMAL_SENSOR_ATTR(fcid, 1),	\
-	DECLARE_FC_THERMAL_SENSOR_ATTR(fcid, 2),	\
-	DECLARE_FC_THERMAL_SENSOR_ATTR(fcid, 3),	\
-	DECLARE_FC_THERMAL_SENSOR_ATTR(fcid, 4),	\
-	DECLARE_FC_THERMAL_SENSOR_ATTR(fcid, 5),	\
-	DECLARE_FC_THERMAL_SENSOR_ATTR(fcid, 6)
-
-/* 4 fan fault attributes in this platform */
-DECLARE_FAN_FAULT_SENSOR_DEV_ATTR(1);
-DECLARE_FAN_FAULT_SENSOR_DEV_ATTR(2);
-DECLARE_FAN_FAULT_SENSOR_DEV_ATTR(3);
-DECLARE_FAN_FAULT_SENSOR_DEV_ATTR(4);
-
-/* 4 fan speed(rpm) attributes in this platform */
-DECLARE_FAN_SPEED_RPM_SENSOR_DEV_ATTR(1);
-DECLARE_FAN_SPEED_RPM_SENSOR_DEV_ATTR(2);
-DECLARE_FAN_SPEED_RPM_SENSOR_DEV_ATTR(3);
-DECLARE_FAN_SPEED_RPM_SENSOR_DEV_ATTR(4);
-
-/* 4 fan present attributes in this platform */
+/* Fan board present attribute */
 DECLARE_FAN_PRESENT_SENSOR_DEV_ATTR();
-DECLARE_FAN_PRESENT_SENSOR_DEV_ATTR(1);
-DECLARE_FAN_PRESENT_SENSOR_DEV_ATTR(2);
-DECLARE_FAN_PRESENT_SENSOR_DEV_ATTR(3);
-DECLARE_FAN_PRESENT_SENSOR_DEV_ATTR(4);
 
 /* 1 fan duty cycle attribute in this platform */
 DECLARE_FAN_DUTY_CYCLE_SENSOR_DEV_ATTR();
 
-/* 6 thermal sensor for each line card */
-DECLARE_LC_THERMAL_SENSOR_DEV_ATTRS(1);
-DECLARE_LC_THERMAL_SENSOR_DEV_ATTRS(2);
-DECLARE_LC_THERMAL_SENSOR_DEV_ATTRS(3);
-DECLARE_LC_THERMAL_SENSOR_DEV_ATTRS(4);
-
-/* 6 thermal sensor for each fabric card */
-DECLARE_FC_THERMAL_SENSOR_DEV_ATTRS(1);
-DECLARE_FC_THERMAL_SENSOR_DEV_ATTRS(2);
-
+/* Board-wide attributes, the per fan and per card sensor ones are built at
+ * probe from fan_attr_desc[] below.
+ */
 static struct attribute *omp800_fc_fan_attributes[] = {
-	/* fan related attributes */
 	&sensor_dev_attr_fan_version.dev_attr.attr,
 	&sensor_dev_attr_fan_enable.dev_attr.attr,
-	DECLARE_FAN_FAULT_ATTR(1),
-	DECLARE_FAN_FAULT_ATTR(2),
-	DECLARE_FAN_FAULT_ATTR(3),
-	DECLARE_FAN_FAULT_ATTR(4),
-	DECLARE_FAN_SPEED_RPM_ATTR(1),
-	DECLARE_FAN_SPEED_RPM_ATTR(2),
-	DECLARE_FAN_SPEED_RPM_ATTR(3),
-	DECLARE_FAN_SPEED_RPM_ATTR(4),
+	&sensor_dev_attr_fan_health_interval.dev_attr.attr,
+	&sensor_dev_attr_fan_nominal_rpm.dev_attr.attr,
+	&sensor_dev_attr_fan_present_interval.dev_attr.attr,
+	&sensor_dev_attr_fan_speed_interval.dev_attr.attr,
+	&sensor_dev_attr_temp_interval.dev_attr.attr,
+	&sensor_dev_attr_thermal_protect.dev_attr.attr,
+	&sensor_dev_attr_thermal_protect_hold.dev_attr.attr,
+	&sensor_dev_attr_chassis_fan_total_rpm.dev_attr.attr,
+	&sensor_dev_attr_chassis_fan_min_rpm.dev_attr.attr,
+	&sensor_dev_attr_chassis_fan_fault.dev_attr.attr,
+	&sensor_dev_attr_chassis_fan_present.dev_attr.attr,
+	&sensor_dev_attr_chassis_fan_duty_cycle_percentage.dev_attr.attr,
 	DECLARE_FAN_PRESENT_ATTR(),
-	DECLARE_FAN_PRESENT_ATTR(1),
-	DECLARE_FAN_PRESENT_ATTR(2),
-	DECLARE_FAN_PRESENT_ATTR(3),
-	DECLARE_FAN_PRESENT_ATTR(4),
 	DECLARE_FAN_DUTY_CYCLE_ATTR(),
-	DECLARE_LC_THERMAL_SENSOR_ATTRS(1),
-	DECLARE_LC_THERMAL_SENSOR_ATTRS(2),
-	DECLARE_LC_THERMAL_SENSOR_ATTRS(3),
-	DECLARE_LC_THERMAL_SENSOR_ATTRS(4),
-	DECLARE_FC_THERMAL_SENSOR_ATTRS(1),
-	DECLARE_FC_THERMAL_SENSOR_ATTRS(2),
+	&sensor_dev_attr_fan_control_mode.dev_attr.attr,
+	&sensor_dev_attr_fan_control_curve.dev_attr.attr,
+	&sensor_dev_attr_fan_control_interval.dev_attr.attr,
+	&sensor_dev_attr_fan_duty_ramp_up.dev_attr.attr,
+	&sensor_dev_attr_fan_duty_ramp_down.dev_attr.attr,
+	&sensor_dev_attr_fan_duty_ramp_interval.dev_attr.attr,
 	NULL
 };
 
+/* Per fan and per card sensor attributes. Instance n of a descriptor uses
+ * sysfs index index + n, fan instances are named after the fan number and
+ * sensor instances after the card and sensor number. Attributes of absent
+ * fans or cards are hidden.
+ */
+enum fan_attr_kind {
+	FAN_ATTR_FAN,		/* "fan%d_...", hidden if the fan is absent */
+	FAN_ATTR_FAN_SLOT,	/* "fan%d_...", always visible */
+	FAN_ATTR_SENSOR		/* "%s_temp%d_...", hidden if the card is absent */
+};
+
+struct fan_attr_desc {
+	const char *name;
+	umode_t		mode;
+	ssize_t	  (*show)(struct device *dev, struct device_attribute *da, char *buf);
+	ssize_t	  (*store)(struct device *dev, struct device_attribute *da, const char *buf, size_t count);
+	int			index;	/* enum sysfs_fan_attributes of instance 0 */
+	u8			kind;	/* enum fan_attr_kind */
+};
+
+static const struct fan_attr_desc fan_attr_desc[] = {
+	{ "fan%d_fault",			S_IRUGO, fan_show_value,	 NULL, FAN1_FAULT,			 FAN_ATTR_FAN },
+	{ "fan%d_health",			S_IRUGO, fan_show_health,	 NULL, FAN1_HEALTH,			 FAN_ATTR_FAN },
+	{ "fan%d_imbalance",		S_IRUGO, fan_show_health,	 NULL, FAN1_IMBALANCE,		 FAN_ATTR_FAN },
+	{ "fan%d_front_speed_rpm",	S_IRUGO, fan_show_value,	 NULL, FAN1_FRONT_SPEED_RPM, FAN_ATTR_FAN },
+	{ "fan%d_rear_speed_rpm",	S_IRUGO, fan_show_value,	 NULL, FAN1_REAR_SPEED_RPM,	 FAN_ATTR_FAN },
+	{ "fan%d_present",			S_IRUGO, fan_show_value,	 NULL, FAN1_PRESENT,		 FAN_ATTR_FAN_SLOT },
+	{ "%s_temp%d_input",		S_IRUGO, temp_show_value,	 NULL, TEMP_INPUT_MIN,		 FAN_ATTR_SENSOR },
+	{ "%s_temp%d_warning",		S_IRUGO, temp_show_warning,	 NULL, TEMP_WARNING_MIN,	 FAN_ATTR_SENSOR },
+	{ "%s_temp%d_shutdown",		S_IRUGO, temp_show_shutdown, NULL, TEMP_SHUTDOWN_MIN,	 FAN_ATTR_SENSOR },
+};
+
+#define FAN_ATTR_NAME_LEN 24
+
+struct fan_dyn_attr {
+	struct sensor_device_attribute sda;
+	char name[FAN_ATTR_NAME_LEN];
+	u8	 kind;		/* enum fan_attr_kind */
+	u8	 instance;	/* Fan or card index */
+};
+
 #define FAN_DUTY_CYCLE_REG_MASK		 	0xF
 #define FAN_MAX_DUTY_CYCLE			  	100
 #define FAN_REG_VAL_TO_SPEED_RPM_STEP   100
@@ -354,6 +583,34 @@ static int omp800_fc_fan_read_value(struct i2c_client *client, u8 reg)
 	return i2c_smbus_read_byte_data(client, reg);
 }
 
+/* Read len contiguous registers, byte by byte if the adapter cannot do
+ * SMBus I2C block reads.
+ */
+static int omp800_fc_fan_read_block(struct i2c_client *client, u8 reg, u8 len, u8 *values)
+{
+	int i, status;
+
+	if (len > 1 && i2c_check_functionality(client->adapter, I2C_FUNC_SMBUS_READ_I2C_BLOCK)) {
+		status = i2c_smbus_read_i2c_block_data(client, reg, len, values);
+		if (status >= 0 && status != len) {
+			status = -EIO;
+		}
+
+		return status;
+	}
+
+	for (i = 0; i < len; i++) {
+		status = omp800_fc_fan_read_value(client, reg + i);
+		if (status < 0) {
+			return status;
+		}
+
+		values[i] = status;
+	}
+
+	return len;
+}
+
 static int omp800_fc_fan_write_value(struct i2c_client *client, u8 reg, u8 value)
 {
 	return i2c_smbus_write_byte_data(client, reg, value);
@@ -411,6 +668,100 @@ static u8 is_fan_fault(struct omp800_fc_fan_data *data, enum fan_id id)
 	return ret;
 }
 
+/* Schedule the next ramp step, no sooner than ramp_interval after the
+ * last write. Called with update_lock held.
+ */
+static void omp800_fc_fan_kick_duty(struct omp800_fc_fan_data *data)
+{
+	unsigned long next = data->duty_last_write + msecs_to_jiffies(data->ramp_interval);
+
+	mod_delayed_work(system_wq, &data->duty_work,
+					 time_before(jiffies, next) ? next - jiffies : 0);
+}
+
+/* Set the duty register target, never below the cooling state requested
+ * by the thermal core. Called with update_lock held, the register is
+ * written by the ramp worker and only when it changes, requests made in
+ * the meantime are coalesced.
+ */
+static int omp800_fc_fan_write_duty(struct omp800_fc_fan_data *data, u8 reg)
+{
+	data->duty_target = reg;
+	data->duty_goal	  = max(reg, data->cooling_state);
+
+	if (data->protect_active) {
+		data->duty_goal = FAN_DUTY_CYCLE_REG_MASK;
+	}
+
+	if (data->duty_goal != data->duty_reg) {
+		omp800_fc_fan_kick_duty(data);
+	}
+
+	return 0;
+}
+
+static void omp800_fc_fan_duty_ramp(struct work_struct *work)
+{
+	struct omp800_fc_fan_data *data = container_of(to_delayed_work(work),
+												   struct omp800_fc_fan_data, duty_work);
+	struct i2c_client *client = data->client;
+	int status, cur, goal, step, next;
+
+	mutex_lock(&data->update_lock);
+
+	goal = data->duty_goal;
+	if (!data->enable || goal == 0xFF || goal == data->duty_reg) {
+		goto exit;
+	}
+
+	cur = data->duty_reg;
+	if (cur == 0xFF) {
+		status = omp800_fc_fan_read_value(client, fan_reg[FAN_DUTY_CYCLE_PERCENTAGE]);
+		cur = (status < 0) ? goal : (status & FAN_DUTY_CYCLE_REG_MASK);
+	}
+
+	step = (goal > cur) ? data->ramp_up : data->ramp_down;
+	if (!step || data->protect_active || abs(goal - cur) <= step) {
+		next = goal;
+	}
+	else {
+		next = (goal > cur) ? cur + step : cur - step;
+	}
+
+	if (!data->watchdog_off) {
+		status = omp800_fc_fan_write_value(client, 0x33, 0); /* Disable fan speed watch dog */
+		if (status < 0) {
+			goto retry;
+		}
+
+		data->watchdog_off = 1;
+	}
+
+	status = omp800_fc_fan_write_value(client, fan_reg[FAN_DUTY_CYCLE_PERCENTAGE], next);
+	if (status < 0) {
+		data->duty_reg = 0xFF;
+		goto retry;
+	}
+
+	//DEBUG_PRINT("duty reg(0x%x), goal(0x%x)", next, goal);
+	data->duty_reg = next;
+	data->reg_val[FAN_DUTY_CYCLE_PERCENTAGE] = next;
+	data->duty_last_write = jiffies;
+
+	if (next != goal) {
+		omp800_fc_fan_kick_duty(data);
+	}
+
+	goto exit;
+
+retry:
+	dev_dbg(&client->dev, "duty write, err %d\n", status);
+	data->duty_last_write = jiffies;
+	omp800_fc_fan_kick_duty(data);
+exit:
+	mutex_unlock(&data->update_lock);
+}
+
 static ssize_t set_duty_cycle(struct device *dev, struct device_attribute *da,
 			const char *buf, size_t count) 
 {
@@ -431,11 +782,117 @@ static ssize_t set_duty_cycle(struct device *dev, struct device_attribute *da,
 	if (value < 0 || value > FAN_MAX_DUTY_CYCLE) {
 		return -EINVAL;
 	}
-	
-	omp800_fc_fan_write_value(client, 0x33, 0); /* Disable fan speed watch dog */
-	omp800_fc_fan_write_value(client, fan_reg[FAN_DUTY_CYCLE_PERCENTAGE], duty_cycle_to_reg_val(value));
-	//DEBUG_PRINT("Write to FanReg(0x%x), Value(0x%x)", fan_reg[FAN_DUTY_CYCLE_PERCENTAGE], duty_cycle_to_reg_val(value));
-	return count;
+
+	mutex_lock(&data->update_lock);
+
+	if (data->control_mode == FAN_CONTROL_AUTO) {
+		mutex_unlock(&data->update_lock);
+		return -EBUSY;
+	}
+
+	error = omp800_fc_fan_write_duty(data, duty_cycle_to_reg_val(value));
+	mutex_unlock(&data->update_lock);
+
+	return error ? error : count;
+}
+
+/* Chassis view over the last valid snapshot of every enabled fan board,
+ * nothing is read from the bus.
+ */
+static ssize_t fan_show_chassis(struct device *dev, struct device_attribute *da, char *buf)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct omp800_fc_fan_data *data;
+	u32 total = 0, min_rpm = U32_MAX, rpm;
+	int present = 0, fault = 0, duty = 0, i;
+
+	mutex_lock(&fan_boards_lock);
+
+	list_for_each_entry(data, &fan_boards, list) {
+		mutex_lock(&data->update_lock);
+
+		if (data->enable && data->valid) {
+			duty = max_t(int, duty, reg_val_to_duty_cycle(data->reg_val[FAN_DUTY_CYCLE_PERCENTAGE]));
+
+			for (i = 0; i < NUM_OF_FAN; i++) {
+				if (!reg_val_to_is_present(data->reg_val[FAN_PRESENT_REG], i)) {
+					continue;
+				}
+
+				present++;
+				fault |= is_fan_fault(data, i);
+
+				rpm = reg_val_to_speed_rpm(data->reg_val[FAN1_FRONT_SPEED_RPM + i]);
+				total += rpm;
+				min_rpm = min(min_rpm, rpm);
+
+				rpm = reg_val_to_speed_rpm(data->reg_val[FAN1_REAR_SPEED_RPM + i]);
+				total += rpm;
+				min_rpm = min(min_rpm, rpm);
+			}
+		}
+
+		mutex_unlock(&data->update_lock);
+	}
+
+	mutex_unlock(&fan_boards_lock);
+
+	switch (attr->index) {
+	case CHASSIS_FAN_TOTAL_RPM:
+		return sprintf(buf, "%u\n", total);
+	case CHASSIS_FAN_MIN_RPM:
+		return sprintf(buf, "%u\n", present ? min_rpm : 0);
+	case CHASSIS_FAN_FAULT:
+		return sprintf(buf, "%d\n", fault);
+	case CHASSIS_FAN_PRESENT:
+		return sprintf(buf, "%d\n", present);
+	case CHASSIS_FAN_DUTY_CYCLE_PERCENTAGE:
+		return sprintf(buf, "%d\n", duty);
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/* Same duty cycle on every enabled fan board, refused if any of them is
+ * under auto control.
+ */
+static ssize_t fan_set_chassis_duty_cycle(struct device *dev, struct device_attribute *da,
+			const char *buf, size_t count)
+{
+	struct omp800_fc_fan_data *data;
+	int error, value;
+
+	error = kstrtoint(buf, 10, &value);
+	if (error) {
+		return error;
+	}
+
+	if (value < 0 || value > FAN_MAX_DUTY_CYCLE) {
+		return -EINVAL;
+	}
+
+	mutex_lock(&fan_boards_lock);
+
+	list_for_each_entry(data, &fan_boards, list) {
+		if (data->control_mode == FAN_CONTROL_AUTO) {
+			error = -EBUSY;
+			goto exit;
+		}
+	}
+
+	list_for_each_entry(data, &fan_boards, list) {
+		mutex_lock(&data->update_lock);
+		if (data->enable && data->control_mode != FAN_CONTROL_AUTO) {
+			omp800_fc_fan_write_duty(data, duty_cycle_to_reg_val(value));
+		}
+		mutex_unlock(&data->update_lock);
+	}
+
+exit:
+	mutex_unlock(&fan_boards_lock);
+	return error ? error : count;
 }
 
 static ssize_t fan_show_enable(struct device *dev, struct device_attribute *da, char *buf)
@@ -459,12 +916,56 @@ static ssize_t fan_set_enable(struct device *dev, struct device_attribute *da,
 	}
 
 	mutex_lock(&data->update_lock);
+
+	/* The other CPU drives the fans while this one is on standby, checked
+	 * under update_lock so it cannot race with an ownership change.
+	 */
+	if (value && omp800_cpld_is_owner() == 0) {
+		mutex_unlock(&data->update_lock);
+		return -EBUSY;
+	}
+
 	data->enable = !!(value);
 	mutex_unlock(&data->update_lock);
 	
 	return count;
 }
 
+/* The fan board is only accessed by the fabric card CPU owning the chassis
+ * control, the standby one leaves the bus alone and refuses fan_enable.
+ */
+static void omp800_fc_fan_set_owner(struct omp800_fc_fan_data *data, int owner)
+{
+	mutex_lock(&data->update_lock);
+
+	if (owner && !data->enable) {
+		dev_info(&data->client->dev, "taking over the fan board\n");
+
+		/* The other CPU may have written anything meanwhile */
+		data->valid		   = 0;
+		data->watchdog_off = 0;
+		data->duty_reg	   = 0xFF;
+		if (data->duty_goal != 0xFF) {
+			omp800_fc_fan_kick_duty(data);
+		}
+	}
+
+	data->enable = !!owner;
+	mutex_unlock(&data->update_lock);
+
+	mutex_lock(&data->temp_update_lock);
+	data->temp_valid = 0;
+	mutex_unlock(&data->temp_update_lock);
+}
+
+static int omp800_fc_fan_owner_event(struct notifier_block *nb, unsigned long state, void *unused)
+{
+	struct omp800_fc_fan_data *data = container_of(nb, struct omp800_fc_fan_data, owner_nb);
+
+	omp800_fc_fan_set_owner(data, omp800_cpld_is_owner() > 0);
+	return NOTIFY_OK;
+}
+
 static ssize_t fan_show_value(struct device *dev, struct device_attribute *da,
 			 char *buf)
 {
@@ -530,95 +1031,843 @@ static const struct attribute_group omp800_fc_fan_group = {
 	.attrs = omp800_fc_fan_attributes,
 };
 
-static struct omp800_fc_fan_data *omp800_fc_fan_update_device(struct device *dev)
+static umode_t omp800_fc_fan_attr_visible(struct kobject *kobj, struct attribute *a, int n)
 {
-	struct i2c_client *client = to_i2c_client(dev);
-	struct omp800_fc_fan_data *data = i2c_get_clientdata(client);
-
-	if (!data->enable) {
-		return data;
+	struct device *dev = container_of(kobj, struct device, kobj);
+	struct omp800_fc_fan_data *data = i2c_get_clientdata(to_i2c_client(dev));
+	struct fan_dyn_attr *attr = &data->dyn[n];
+
+	switch (attr->kind) {
+	case FAN_ATTR_FAN:
+		return (data->fan_hidden & BIT(attr->instance)) ? 0 : a->mode;
+	case FAN_ATTR_SENSOR:
+		return (data->card_hidden & BIT(attr->instance)) ? 0 : a->mode;
+	default:
+		return a->mode;
 	}
+}
 
-	mutex_lock(&data->update_lock);
+static void omp800_fc_fan_attr_refresh(struct work_struct *work)
+{
+	struct omp800_fc_fan_data *data = container_of(work, struct omp800_fc_fan_data, dyn_work);
+	u8 dead;
 
-	if (time_after(jiffies, data->last_updated + HZ + HZ / 2) || 
-		!data->valid) {
-		int i;
+	mutex_lock(&data->update_lock);
+	dead = data->dyn_dead;
+	mutex_unlock(&data->update_lock);
 
-		dev_dbg(&client->dev, "Starting omp800_fc_fan update\n");
-		data->valid = 0;
-		
-		/* Update fan data
-		 */
-		for (i = 0; i < ARRAY_SIZE(data->reg_val); i++) {
-			int status = omp800_fc_fan_read_value(client, fan_reg[i]);
-			
-			if (status < 0) {
-				dev_dbg(&client->dev, "reg %d, err %d\n", fan_reg[i], status);
-				goto exit;
-			}
-			else {
-				data->reg_val[i] = status;
-			}
-		}
-		
-		data->last_updated = jiffies;
-		data->valid = 1;
+	if (!dead && sysfs_update_group(&data->client->dev.kobj, &data->dyn_group)) {
+		dev_dbg(&data->client->dev, "failed to refresh the fan/sensor attributes\n");
 	}
+}
 
-exit:
-	mutex_unlock(&data->update_lock);
-	return data;
+/* Called whenever presence was sampled, masks are only written by their
+ * own refresh path.
+ */
+static void omp800_fc_fan_attr_hide(struct omp800_fc_fan_data *data, u8 *mask, u8 hidden)
+{
+	if (*mask != hidden) {
+		*mask = hidden;
+		schedule_work(&data->dyn_work);
+	}
 }
 
-static struct omp800_fc_fan_data *omp800_fc_fan_update_temp(struct device *dev)
+static int omp800_fc_fan_attr_build(struct omp800_fc_fan_data *data)
 {
-	int i = 0;
-	struct i2c_client *client = to_i2c_client(dev);
-	struct omp800_fc_fan_data *data = i2c_get_clientdata(client);
+	struct fan_dyn_attr *attr;
+	int i, n, num = 0;
 
-	if (!data->enable) {
-		return data;
+	for (i = 0; i < ARRAY_SIZE(fan_attr_desc); i++) {
+		num += (fan_attr_desc[i].kind == FAN_ATTR_SENSOR) ? NUM_OF_THERMAL_SENSORS : NUM_OF_FAN;
 	}
 
-	if (time_before(jiffies, data->temp_last_updated + HZ*3) &&
-		data->temp_valid) {
-		return data;
+	data->dyn		= kcalloc(num, sizeof(*data->dyn), GFP_KERNEL);
+	data->dyn_attrs = kcalloc(num + 1, sizeof(*data->dyn_attrs), GFP_KERNEL);
+	if (!data->dyn || !data->dyn_attrs) {
+		kfree(data->dyn);
+		kfree(data->dyn_attrs);
+		return -ENOMEM;
 	}
 
-	mutex_lock(&data->temp_update_lock);
-	dev_dbg(&client->dev, "Starting omp800_fc_fan temp sensor update\n");
-	data->temp_valid = 0;
+	attr = data->dyn;
 
-	/* Update temp sensor data
-	 */
-	for (i = 0; i < ARRAY_SIZE(data->temp_reg_val); i++) {
-		int reg = 0x50 + (i/6 << 4) + (i%6);
-		int status;
+	for (i = 0; i < ARRAY_SIZE(fan_attr_desc); i++) {
+		const struct fan_attr_desc *desc = &fan_attr_desc[i];
 
-		status = omp800_fc_fan_read_value(client, reg);
+		num = (desc->kind == FAN_ATTR_SENSOR) ? NUM_OF_THERMAL_SENSORS : NUM_OF_FAN;
 
-		if (status < 0) {
-			dev_dbg(&client->dev, "reg %d, err %d\n", reg, status);
-			goto exit;
-		}
-		else {
-			data->temp_reg_val[i] = status;
-		}
+		for (n = 0; n < num; n++, attr++) {
+			if (desc->kind == FAN_ATTR_SENSOR) {
+				attr->instance = n / NUM_OF_THERMAL_PER_CARD;
+				snprintf(attr->name, sizeof(attr->name), desc->name,
+						 card_name[attr->instance], n % NUM_OF_THERMAL_PER_CARD + 1);
+			}
+			else {
+				attr->instance = n;
+				snprintf(attr->name, sizeof(attr->name), desc->name, n + 1);
+			}
 
-		//DEBUG_PRINT("temp reg (0x%x), value = (0x%x)", reg, data->temp_reg_val[i]);
+			attr->kind = desc->kind;
+			sysfs_attr_init(&attr->sda.dev_attr.attr);
+			attr->sda.dev_attr.attr.name = attr->name;
+			attr->sda.dev_attr.attr.mode = desc->mode;
+			attr->sda.dev_attr.show		 = desc->show;
+			attr->sda.dev_attr.store	 = desc->store;
+			attr->sda.index				 = desc->index + n;
+			data->dyn_attrs[attr - data->dyn] = &attr->sda.dev_attr.attr;
+		}
 	}
 
-	data->temp_last_updated = jiffies;
-	data->temp_valid = 1;
+	data->dyn_group.attrs	   = data->dyn_attrs;
+	data->dyn_group.is_visible = omp800_fc_fan_attr_visible;
+	INIT_WORK(&data->dyn_work, omp800_fc_fan_attr_refresh);
 
-exit:
-	mutex_unlock(&data->temp_update_lock);
-	return data;
+	return 0;
 }
 
-static ssize_t temp_show_warning(struct device *dev, struct device_attribute *da,
-			 char *buf)
+static void omp800_fc_fan_attr_free(struct omp800_fc_fan_data *data)
+{
+	kfree(data->dyn_attrs);
+	kfree(data->dyn);
+}
+
+static void fan_health_ewma(int *avg, int ratio)
+{
+	ratio = min(ratio, FAN_HEALTH_MAX_RATIO);
+	*avg += (ratio - *avg) / FAN_HEALTH_EWMA_WEIGHT;
+}
+
+/* Record the last fan refresh, called with update_lock held */
+static void omp800_fc_fan_health_record(struct omp800_fc_fan_data *data)
+{
+	struct fan_health_sample *sample = &data->history[data->history_head];
+	const u8 *rpm = &data->reg_val[FAN1_FRONT_SPEED_RPM];
+	int sum[2] = { 0, 0 }, num[2] = { 0, 0 };
+	int i, j, row, peers, steady;
+	u32 expected;
+
+	/* Fans lag behind a new duty, only compare with the curve at a
+	 * duty already seen on the previous refresh.
+	 */
+	steady = data->history_count &&
+			 data->history[(data->history_head + FAN_HEALTH_HISTORY - 1) % FAN_HEALTH_HISTORY].duty ==
+			 (data->reg_val[FAN_DUTY_CYCLE_PERCENTAGE] & FAN_DUTY_CYCLE_REG_MASK);
+
+	memset(sample, 0, sizeof(*sample));
+	sample->msecs = jiffies_to_msecs(jiffies);
+	sample->duty  = data->reg_val[FAN_DUTY_CYCLE_PERCENTAGE] & FAN_DUTY_CYCLE_REG_MASK;
+	memcpy(sample->rpm, rpm, NUM_OF_ROTOR);
+
+	data->history_head = (data->history_head + 1) % FAN_HEALTH_HISTORY;
+	if (data->history_count < FAN_HEALTH_HISTORY) {
+		data->history_count++;
+	}
+
+	/* Fans may be stopped on purpose */
+	if (!reg_val_to_duty_cycle(sample->duty)) {
+		return;
+	}
+
+	for (i = 0; i < NUM_OF_ROTOR; i++) {
+		if (!reg_val_to_is_present(data->reg_val[FAN_PRESENT_REG], i % NUM_OF_FAN)) {
+			continue;
+		}
+
+		sum[i / NUM_OF_FAN] += rpm[i];
+		num[i / NUM_OF_FAN]++;
+
+		/* Expected speed from the duty curve of the row */
+		expected = data->nominal_rpm[i / NUM_OF_FAN] * reg_val_to_duty_cycle(sample->duty) /
+				   FAN_MAX_DUTY_CYCLE;
+		if (steady && expected) {
+			fan_health_ewma(&data->health[i], reg_val_to_speed_rpm(rpm[i]) * 1000 / expected);
+		}
+	}
+
+	for (i = 0; i < NUM_OF_ROTOR; i++) {
+		row = i / NUM_OF_FAN;
+
+		if (!reg_val_to_is_present(data->reg_val[FAN_PRESENT_REG], i % NUM_OF_FAN)) {
+			continue;
+		}
+
+		/* Secondary check, the average of the other rotors in the row */
+		peers = num[row] - 1;
+		j = sum[row] - rpm[i];
+		if (!peers || !j) {
+			continue;
+		}
+
+		fan_health_ewma(&data->peer_health[i], rpm[i] * 1000 * peers / j);
+	}
+
+	if (!sum[0] || !sum[1]) {
+		return;
+	}
+
+	for (i = 0; i < NUM_OF_FAN; i++) {
+		if (!reg_val_to_is_present(data->reg_val[FAN_PRESENT_REG], i) || !rpm[i + NUM_OF_FAN]) {
+			continue;
+		}
+
+		fan_health_ewma(&data->balance[i], rpm[i] * 1000 * sum[1] / (rpm[i + NUM_OF_FAN] * sum[0]));
+	}
+}
+
+/* 100 for a fan at its nominal speed, as fast as its peers and in
+ * balance, lower as it drifts
+ */
+static int fan_health_score(struct omp800_fc_fan_data *data, enum fan_id id)
+{
+	int score = 1000;
+
+	score = min(score, data->health[id]);
+	score = min(score, data->health[id + NUM_OF_FAN]);
+	score = min(score, data->peer_health[id]);
+	score = min(score, data->peer_health[id + NUM_OF_FAN]);
+	score = min(score, 1000 - abs(data->balance[id] - 1000));
+
+	return max(score, 0) / 10;
+}
+
+static ssize_t fan_show_health(struct device *dev, struct device_attribute *da, char *buf)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_fc_fan_data *data = i2c_get_clientdata(client);
+	ssize_t ret = 0;
+
+	mutex_lock(&data->update_lock);
+
+	switch (attr->index) {
+	case FAN1_HEALTH:
+	case FAN2_HEALTH:
+	case FAN3_HEALTH:
+	case FAN4_HEALTH:
+		ret = sprintf(buf, "%d\n", fan_health_score(data, attr->index - FAN1_HEALTH));
+		break;
+	case FAN1_IMBALANCE:
+	case FAN2_IMBALANCE:
+	case FAN3_IMBALANCE:
+	case FAN4_IMBALANCE:
+		ret = sprintf(buf, "%d\n",
+					  abs(data->balance[attr->index - FAN1_IMBALANCE] - 1000) > FAN_HEALTH_IMBALANCE);
+		break;
+	case FAN_HEALTH_INTERVAL:
+		ret = sprintf(buf, "%u\n", data->health_interval);
+		break;
+	case FAN_NOMINAL_RPM:
+		ret = sprintf(buf, "%u %u\n", data->nominal_rpm[0], data->nominal_rpm[1]);
+		break;
+	default:
+		break;
+	}
+
+	mutex_unlock(&data->update_lock);
+	return ret;
+}
+
+static ssize_t fan_set_health(struct device *dev, struct device_attribute *da,
+			const char *buf, size_t count)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_fc_fan_data *data = i2c_get_clientdata(client);
+	unsigned int interval, rpm[2];
+	int i, error;
+
+	/* "<front rpm> <rear rpm>" at 100% duty, 0 if unknown */
+	if (attr->index == FAN_NOMINAL_RPM) {
+		if (sscanf(buf, "%u %u", &rpm[0], &rpm[1]) != 2 ||
+			rpm[0] > FAN_HEALTH_MAX_NOMINAL_RPM || rpm[1] > FAN_HEALTH_MAX_NOMINAL_RPM) {
+			return -EINVAL;
+		}
+
+		mutex_lock(&data->update_lock);
+		data->nominal_rpm[0] = rpm[0];
+		data->nominal_rpm[1] = rpm[1];
+		for (i = 0; i < NUM_OF_ROTOR; i++) {
+			data->health[i] = 1000;
+		}
+		mutex_unlock(&data->update_lock);
+
+		return count;
+	}
+
+	error = kstrtouint(buf, 10, &interval);
+	if (error) {
+		return error;
+	}
+
+	if (interval && interval < 1000) {
+		return -EINVAL;
+	}
+
+	mutex_lock(&data->update_lock);
+	data->health_interval = interval;
+	mutex_unlock(&data->update_lock);
+
+	if (interval) {
+		mod_delayed_work(system_wq, &data->health_work, 0);
+	}
+	else {
+		cancel_delayed_work_sync(&data->health_work);
+	}
+
+	return count;
+}
+
+static void omp800_fc_fan_health_refresh(struct work_struct *work)
+{
+	struct omp800_fc_fan_data *data = container_of(to_delayed_work(work),
+												   struct omp800_fc_fan_data, health_work);
+	unsigned int interval;
+
+	omp800_fc_fan_update_device(&data->client->dev);
+
+	mutex_lock(&data->update_lock);
+	interval = data->health_interval;
+	mutex_unlock(&data->update_lock);
+
+	if (interval) {
+		schedule_delayed_work(&data->health_work, msecs_to_jiffies(interval));
+	}
+}
+
+static ssize_t fan_read_health_history(struct file *filp, struct kobject *kobj,
+									   struct bin_attribute *attr,
+									   char *buf, loff_t off, size_t count)
+{
+	struct device *dev = container_of(kobj, struct device, kobj);
+	struct omp800_fc_fan_data *data = i2c_get_clientdata(to_i2c_client(dev));
+	struct fan_health_sample *history;
+	size_t size;
+	int i, first;
+
+	history = kmalloc(sizeof(data->history), GFP_KERNEL);
+	if (!history) {
+		return -ENOMEM;
+	}
+
+	mutex_lock(&data->update_lock);
+	first = (data->history_head + FAN_HEALTH_HISTORY - data->history_count) % FAN_HEALTH_HISTORY;
+	for (i = 0; i < data->history_count; i++) {
+		history[i] = data->history[(first + i) % FAN_HEALTH_HISTORY];
+	}
+	size = data->history_count * sizeof(struct fan_health_sample);
+	mutex_unlock(&data->update_lock);
+
+	if (off >= size) {
+		count = 0;
+	}
+	else {
+		count = min_t(size_t, count, size - off);
+		memcpy(buf, (u8 *)history + off, count);
+	}
+
+	kfree(history);
+	return count;
+}
+
+static struct bin_attribute fan_health_history_attr = {
+	.attr = {
+		.name = "fan_health_history",
+		.mode = S_IRUGO,
+	},
+	.size = sizeof(struct fan_health_sample) * FAN_HEALTH_HISTORY,
+	.read = fan_read_health_history,
+};
+
+/* Read the blocks of the due classes, merging neighbours separated by at
+ * most FAN_SAMPLE_GAP unused registers. Called with update_lock held.
+ */
+static int omp800_fc_fan_sample(struct omp800_fc_fan_data *data, u8 due)
+{
+	struct i2c_client *client = data->client;
+	u8 values[I2C_SMBUS_BLOCK_MAX];
+	int i, j, k, status;
+
+	for (i = 0; i < ARRAY_SIZE(fan_reg_block); i = j) {
+		u8 start = fan_reg[fan_reg_block[i].index];
+		u8 end	 = start + fan_reg_block[i].len;
+
+		j = i + 1;
+
+		if (!(due & BIT(fan_reg_block[i].class))) {
+			continue;
+		}
+
+		for (; j < ARRAY_SIZE(fan_reg_block); j++) {
+			const struct fan_reg_block *next = &fan_reg_block[j];
+			u8 reg = fan_reg[next->index];
+
+			if (!(due & BIT(next->class)) || reg - end > FAN_SAMPLE_GAP ||
+				reg + next->len - start > sizeof(values)) {
+				break;
+			}
+
+			end = reg + next->len;
+		}
+
+		status = omp800_fc_fan_read_block(client, start, end - start, values);
+		if (status < 0) {
+			dev_dbg(&client->dev, "reg %d, err %d\n", start, status);
+			return status;
+		}
+
+		for (k = i; k < j; k++) {
+			const struct fan_reg_block *block = &fan_reg_block[k];
+
+			memcpy(&data->reg_val[block->index], &values[fan_reg[block->index] - start], block->len);
+		}
+	}
+
+	return 0;
+}
+
+/* != 0 if a rotor started or stopped turning, i.e. a fan may have been
+ * inserted or removed.
+ */
+static int omp800_fc_fan_speed_changed(const u8 *old, const u8 *new)
+{
+	int i;
+
+	for (i = 0; i < NUM_OF_ROTOR; i++) {
+		if (!old[i] != !new[i]) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static struct omp800_fc_fan_data *omp800_fc_fan_update_device(struct device *dev)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_fc_fan_data *data = i2c_get_clientdata(client);
+	u8 speed[NUM_OF_ROTOR];
+	unsigned long now;
+	int i, status;
+	u8 due = 0;
+
+	if (!data->enable) {
+		return data;
+	}
+
+	mutex_lock(&data->update_lock);
+
+	for (i = 0; i < FAN_SAMPLE_NUM_CLASSES; i++) {
+		if (!data->valid ||
+			time_after_eq(jiffies, data->sample_updated[i] + msecs_to_jiffies(data->sample_interval[i]))) {
+			due |= BIT(i);
+		}
+	}
+
+	if (!due) {
+		goto exit;
+	}
+
+	dev_dbg(&client->dev, "Starting omp800_fc_fan update, classes 0x%x\n", due);
+
+	if (!data->valid) {
+		status = omp800_fc_fan_read_value(client, fan_reg[FAN_VERSION]);
+		if (status < 0) {
+			dev_dbg(&client->dev, "reg %d, err %d\n", fan_reg[FAN_VERSION], status);
+			goto exit;
+		}
+
+		data->reg_val[FAN_VERSION] = status;
+
+		/* The board may have been replaced, forget what was written */
+		data->watchdog_off = 0;
+		data->duty_reg	   = 0xFF;
+		if (data->duty_goal != 0xFF) {
+			omp800_fc_fan_kick_duty(data);
+		}
+	}
+
+	memcpy(speed, &data->reg_val[FAN1_FRONT_SPEED_RPM], sizeof(speed));
+	data->valid = 0;
+
+	status = omp800_fc_fan_sample(data, due);
+	if (status < 0) {
+		goto exit;
+	}
+
+	if ((due & BIT(FAN_SAMPLE_SPEED)) && !(due & BIT(FAN_SAMPLE_PRESENT)) &&
+		omp800_fc_fan_speed_changed(speed, &data->reg_val[FAN1_FRONT_SPEED_RPM])) {
+		due |= BIT(FAN_SAMPLE_PRESENT);
+
+		status = omp800_fc_fan_sample(data, BIT(FAN_SAMPLE_PRESENT));
+		if (status < 0) {
+			goto exit;
+		}
+	}
+
+	now = jiffies;
+	for (i = 0; i < FAN_SAMPLE_NUM_CLASSES; i++) {
+		if (due & BIT(i)) {
+			data->sample_updated[i] = now;
+		}
+	}
+
+	data->valid = 1;
+
+	if (due & BIT(FAN_SAMPLE_PRESENT)) {
+		u8 hidden = 0;
+
+		for (i = 0; i < NUM_OF_FAN; i++) {
+			if (!reg_val_to_is_present(data->reg_val[FAN_PRESENT_REG], i)) {
+				hidden |= BIT(i);
+			}
+		}
+
+		omp800_fc_fan_attr_hide(data, &data->fan_hidden, hidden);
+	}
+
+	if (due & BIT(FAN_SAMPLE_SPEED)) {
+		omp800_fc_fan_health_record(data);
+	}
+
+exit:
+	mutex_unlock(&data->update_lock);
+	return data;
+}
+
+static ssize_t fan_show_sample(struct device *dev, struct device_attribute *da, char *buf)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_fc_fan_data *data = i2c_get_clientdata(client);
+	unsigned int value;
+
+	if (attr->index == TEMP_INTERVAL) {
+		mutex_lock(&data->temp_update_lock);
+		value = data->temp_interval;
+		mutex_unlock(&data->temp_update_lock);
+	}
+	else {
+		mutex_lock(&data->update_lock);
+		value = data->sample_interval[(attr->index == FAN_PRESENT_INTERVAL) ?
+									  FAN_SAMPLE_PRESENT : FAN_SAMPLE_SPEED];
+		mutex_unlock(&data->update_lock);
+	}
+
+	return sprintf(buf, "%u\n", value);
+}
+
+static ssize_t fan_set_sample(struct device *dev, struct device_attribute *da,
+			const char *buf, size_t count)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_fc_fan_data *data = i2c_get_clientdata(client);
+	int error, value;
+
+	error = kstrtoint(buf, 10, &value);
+	if (error) {
+		return error;
+	}
+
+	if (value < 100 || value > 60000) {
+		return -EINVAL;
+	}
+
+	if (attr->index == TEMP_INTERVAL) {
+		mutex_lock(&data->temp_update_lock);
+		data->temp_interval = value;
+		mutex_unlock(&data->temp_update_lock);
+	}
+	else {
+		mutex_lock(&data->update_lock);
+		data->sample_interval[(attr->index == FAN_PRESENT_INTERVAL) ?
+							  FAN_SAMPLE_PRESENT : FAN_SAMPLE_SPEED] = value;
+		mutex_unlock(&data->update_lock);
+	}
+
+	return count;
+}
+
+/* Compare the new snapshot with the shutdown table, called with
+ * temp_update_lock held. Returns the cards which just tripped, cool is set
+ * if every sensor is below its warning degree.
+ */
+static u8 omp800_fc_fan_protect_check(struct omp800_fc_fan_data *data, int *cool)
+{
+	struct i2c_client *client = data->client;
+	u8 tripped = 0, hot = 0;
+	int i, card, n, temp;
+
+	*cool = 1;
+
+	for (i = 0; i < NUM_OF_THERMAL_SENSORS; i++) {
+		card = i / NUM_OF_THERMAL_PER_CARD;
+		n	 = i % NUM_OF_THERMAL_PER_CARD;
+
+		if (!(data->temp_present & BIT(card))) {
+			clear_bit(i, data->protect_over);
+			continue;
+		}
+
+		temp = (s8)data->temp_reg_val[i] * 1000;
+
+		if (temp >= temp_warning_degree[n]) {
+			*cool = 0;
+			hot |= BIT(card);
+		}
+
+		if (temp < temp_shutdown_degree[n]) {
+			clear_bit(i, data->protect_over);
+			continue;
+		}
+
+		if (!test_and_set_bit(i, data->protect_over)) {
+			data->protect_over_since[i] = jiffies;
+		}
+
+		if (time_after_eq(jiffies, data->protect_over_since[i] + msecs_to_jiffies(data->protect_hold)) &&
+			!(data->protect_tripped & BIT(card))) {
+			dev_crit(&client->dev, "%s_temp%d_input %d >= shutdown degree %d\n",
+					 card_name[card], n + 1, temp, temp_shutdown_degree[n]);
+			tripped |= BIT(card);
+		}
+	}
+
+	/* Re-arm the cards which cooled down */
+	data->protect_tripped = (data->protect_tripped & hot) | tripped;
+
+	return tripped;
+}
+
+static void omp800_fc_fan_protect_act(struct omp800_fc_fan_data *data, u8 actions,
+									  u8 tripped, int cool)
+{
+	struct i2c_client *client = data->client;
+	int (*set_hot_swap)(int, unsigned short, int);
+	int card, status;
+
+	mutex_lock(&data->update_lock);
+
+	if (tripped && (actions & FAN_PROTECT_FANS) && !data->protect_active) {
+		dev_crit(&client->dev, "thermal protection, fans to 100%%\n");
+		data->protect_active = 1;
+		data->duty_goal		 = FAN_DUTY_CYCLE_REG_MASK;
+		mod_delayed_work(system_wq, &data->duty_work, 0);
+	}
+	else if (cool && data->protect_active) {
+		dev_info(&client->dev, "thermal protection, fans released\n");
+		data->protect_active = 0;
+		if (data->duty_target != 0xFF) {
+			omp800_fc_fan_write_duty(data, data->duty_target);
+		}
+	}
+
+	mutex_unlock(&data->update_lock);
+
+	for (card = 0; card < NUM_OF_CARD; card++) {
+		if (!(tripped & BIT(card)) || !(actions & (FAN_PROTECT_RESET | FAN_PROTECT_POWER_OFF))) {
+			continue;
+		}
+
+		if (!protect_cpld[card]) {
+			dev_crit(&client->dev, "thermal protection, %s left alone (no target)\n", card_name[card]);
+			continue;
+		}
+
+		/* Make sure the target is a card of the expected type, and
+		 * never reset or power off the card we run on.
+		 */
+		status = omp800_cpld_remote_slot_id(protect_cpld[card]);
+		if (status < 0 || !(status & 0x10) != (card < NUM_OF_LINECARD)) {
+			dev_crit(&client->dev, "thermal protection, %s left alone (slot id %d)\n",
+					 card_name[card], status);
+			continue;
+		}
+
+		status = omp800_cpld_remote_is_local(protect_cpld[card]);
+		if (status != 0) {
+			dev_crit(&client->dev, "thermal protection, %s left alone (%s)\n",
+					 card_name[card], (status > 0) ? "local card" : "slot unknown");
+			continue;
+		}
+
+		if (actions & FAN_PROTECT_RESET) {
+			status = omp800_cpld_remote_reset(protect_cpld[card], FAN_PROTECT_RESET_COMPONENT, 1);
+			dev_crit(&client->dev, "thermal protection, %s held in reset (%d)\n",
+					 card_name[card], status);
+		}
+
+		if ((actions & FAN_PROTECT_POWER_OFF) && protect_hotswap[card]) {
+			/* The ADM1278 driver is optional */
+			set_hot_swap = symbol_get(adm1278_set_hot_swap);
+			status = set_hot_swap ? set_hot_swap(CARD_HOTSWAP_BUS, protect_hotswap[card], 0) : -ENODEV;
+			if (set_hot_swap) {
+				symbol_put(adm1278_set_hot_swap);
+			}
+
+			dev_crit(&client->dev, "thermal protection, %s powered off (%d)\n",
+					 card_name[card], status);
+		}
+		else if (actions & FAN_PROTECT_POWER_OFF) {
+			dev_crit(&client->dev, "thermal protection, %s not powered off (no target)\n",
+					 card_name[card]);
+		}
+	}
+}
+
+static void omp800_fc_fan_protect_sweep(struct work_struct *work)
+{
+	struct omp800_fc_fan_data *data = container_of(to_delayed_work(work),
+												   struct omp800_fc_fan_data, protect_work);
+	u8 protect;
+
+	omp800_fc_fan_update_temp(&data->client->dev);
+
+	mutex_lock(&data->temp_update_lock);
+	protect = data->protect;
+	mutex_unlock(&data->temp_update_lock);
+
+	if (protect) {
+		schedule_delayed_work(&data->protect_work, msecs_to_jiffies(FAN_PROTECT_INTERVAL));
+	}
+}
+
+static ssize_t fan_show_protect(struct device *dev, struct device_attribute *da, char *buf)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_fc_fan_data *data = i2c_get_clientdata(client);
+	int value;
+
+	mutex_lock(&data->temp_update_lock);
+	value = (attr->index == THERMAL_PROTECT) ? data->protect : data->protect_hold;
+	mutex_unlock(&data->temp_update_lock);
+
+	return sprintf(buf, "%d\n", value);
+}
+
+static ssize_t fan_set_protect(struct device *dev, struct device_attribute *da,
+			const char *buf, size_t count)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_fc_fan_data *data = i2c_get_clientdata(client);
+	int error, value;
+
+	error = kstrtoint(buf, 0, &value);
+	if (error) {
+		return error;
+	}
+
+	if (attr->index == THERMAL_PROTECT_HOLD) {
+		if (value < 0 || value > FAN_PROTECT_MAX_HOLD) {
+			return -EINVAL;
+		}
+
+		mutex_lock(&data->temp_update_lock);
+		data->protect_hold = value;
+		mutex_unlock(&data->temp_update_lock);
+		return count;
+	}
+
+	if (value & ~FAN_PROTECT_MASK) {
+		return -EINVAL;
+	}
+
+	mutex_lock(&data->temp_update_lock);
+	data->protect = value;
+	mutex_unlock(&data->temp_update_lock);
+
+	/* Do not leave the fans pinned once the policy no longer asks for it */
+	if (!(value & FAN_PROTECT_FANS)) {
+		mutex_lock(&data->update_lock);
+		if (data->protect_active) {
+			data->protect_active = 0;
+			if (data->duty_target != 0xFF) {
+				omp800_fc_fan_write_duty(data, data->duty_target);
+			}
+		}
+		mutex_unlock(&data->update_lock);
+	}
+
+	if (value) {
+		mod_delayed_work(system_wq, &data->protect_work, 0);
+	}
+	else {
+		cancel_delayed_work_sync(&data->protect_work);
+	}
+
+	return count;
+}
+
+static struct omp800_fc_fan_data *omp800_fc_fan_update_temp(struct device *dev)
+{
+	int i = 0;
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_fc_fan_data *data = i2c_get_clientdata(client);
+	u8 temps[NUM_OF_THERMAL_SENSORS];
+	u8 present = 0, tripped = 0, actions = 0;
+	int cool = 0;
+
+	if (!data->enable) {
+		return data;
+	}
+
+	mutex_lock(&data->temp_update_lock);
+
+	if (time_before(jiffies, data->temp_last_updated + msecs_to_jiffies(data->temp_interval)) &&
+		data->temp_valid) {
+		goto exit;
+	}
+
+	dev_dbg(&client->dev, "Starting omp800_fc_fan temp sensor update\n");
+
+	/* Update temp sensor data, one block read per populated card. The
+	 * snapshot is committed only when all of them are read.
+	 */
+	memset(temps, 0, sizeof(temps));
+
+	for (i = 0; i < NUM_OF_CARD; i++) {
+		int status;
+
+		if (omp800_cpld_remote_present(card_cpld_addr[i]) == 0) {
+			continue;
+		}
+
+		status = omp800_fc_fan_read_block(client, TEMP_CARD_REG(i), NUM_OF_THERMAL_PER_CARD,
+										  &temps[i * NUM_OF_THERMAL_PER_CARD]);
+		if (status < 0) {
+			dev_dbg(&client->dev, "reg %d, err %d\n", TEMP_CARD_REG(i), status);
+			data->temp_valid = 0;
+			goto exit;
+		}
+
+		present |= BIT(i);
+	}
+
+	memcpy(data->temp_reg_val, temps, sizeof(temps));
+	data->temp_present = present;
+	data->temp_last_updated = jiffies;
+	data->temp_valid = 1;
+	omp800_fc_fan_attr_hide(data, &data->card_hidden, ~present & (BIT(NUM_OF_CARD) - 1));
+
+	if (data->protect) {
+		actions = data->protect;
+		tripped = omp800_fc_fan_protect_check(data, &cool);
+	}
+
+exit:
+	mutex_unlock(&data->temp_update_lock);
+
+	if (actions) {
+		omp800_fc_fan_protect_act(data, actions, tripped, cool);
+	}
+
+	return data;
+}
+
+static ssize_t temp_show_warning(struct device *dev, struct device_attribute *da,
+			 char *buf)
 {
 	int index;
 	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
@@ -627,33 +1876,527 @@ static ssize_t temp_show_warning(struct device *dev, struct device_attribute *da
 	return sprintf(buf, "%d\n", temp_warning_degree[index]);
 }
 
-static ssize_t temp_show_shutdown(struct device *dev, struct device_attribute *da,
-			 char *buf)
+static ssize_t temp_show_shutdown(struct device *dev, struct device_attribute *da,
+			 char *buf)
+{
+	int index;
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+
+	index = (attr->index - TEMP_SHUTDOWN_MIN) % NUM_OF_THERMAL_PER_CARD;
+	return sprintf(buf, "%d\n", temp_shutdown_degree[index]);	
+}
+
+static ssize_t temp_show_value(struct device *dev, struct device_attribute *da,
+			 char *buf)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct omp800_fc_fan_data *data = omp800_fc_fan_update_temp(dev);
+	int index = attr->index - TEMP_INPUT_MIN;
+	ssize_t ret;
+
+	if (!data->enable) {
+		//DEBUG_PRINT("Fan board is disabled");
+		return sprintf(buf, "0\n");
+	}
+
+	mutex_lock(&data->temp_update_lock);
+
+	if (!data->temp_valid) {
+		ret = -EIO;
+	}
+	else if (!(data->temp_present & BIT(index / NUM_OF_THERMAL_PER_CARD))) {
+		ret = -ENODEV;
+	}
+	else {
+		ret = sprintf(buf, "%d\n", (s8)data->temp_reg_val[index] * 1000);
+	}
+
+	mutex_unlock(&data->temp_update_lock);
+	return ret;
+}
+
+/* Duty cycle for a temperature x m degree C above the warning degree */
+static u8 fan_curve_duty(struct omp800_fc_fan_data *data, int x)
+{
+	const struct fan_curve_point *p = data->curve;
+	int i, x0, x1;
+
+	if (x <= p[0].offset * 1000) {
+		return p[0].duty;
+	}
+
+	for (i = 1; i < data->num_points; i++) {
+		x0 = p[i-1].offset * 1000;
+		x1 = p[i].offset * 1000;
+
+		if (x <= x1) {
+			return p[i-1].duty + (p[i].duty - p[i-1].duty) * (x - x0) / (x1 - x0);
+		}
+	}
+
+	return p[data->num_points - 1].duty;
+}
+
+/* Hottest sensor of each class over the populated cards, compared with
+ * the warning/shutdown tables. Returns the worst temperature relative to
+ * the warning degree in m degree C, INT_MAX if a class is at or above
+ * its shutdown degree or if the sensors cannot be read.
+ */
+static int omp800_fc_fan_thermal_margin(struct omp800_fc_fan_data *data)
+{
+	int card, n, temp, hottest, worst = INT_MIN;
+
+	omp800_fc_fan_update_temp(&data->client->dev);
+
+	mutex_lock(&data->temp_update_lock);
+
+	if (!data->temp_valid) {
+		worst = INT_MAX;
+		goto exit;
+	}
+
+	for (n = 0; n < NUM_OF_THERMAL_PER_CARD; n++) {
+		hottest = INT_MIN;
+
+		for (card = 0; card < NUM_OF_CARD; card++) {
+			if (!(data->temp_present & BIT(card))) {
+				continue;
+			}
+
+			temp = (s8)data->temp_reg_val[card * NUM_OF_THERMAL_PER_CARD + n] * 1000;
+			hottest = max(hottest, temp);
+		}
+
+		if (hottest == INT_MIN) {
+			continue;
+		}
+
+		if (hottest >= temp_shutdown_degree[n]) {
+			worst = INT_MAX;
+			goto exit;
+		}
+
+		worst = max(worst, hottest - temp_warning_degree[n]);
+	}
+
+exit:
+	mutex_unlock(&data->temp_update_lock);
+	return worst;
+}
+
+static void omp800_fc_fan_control(struct work_struct *work)
+{
+	struct omp800_fc_fan_data *data = container_of(to_delayed_work(work),
+												   struct omp800_fc_fan_data, control_work);
+	struct i2c_client *client = data->client;
+	int margin, duty, status;
+
+	margin = data->enable ? omp800_fc_fan_thermal_margin(data) : INT_MIN;
+
+	mutex_lock(&data->update_lock);
+
+	if (data->control_mode != FAN_CONTROL_AUTO) {
+		goto exit;
+	}
+
+	if (!data->enable || margin == INT_MIN) {
+		goto reschedule;
+	}
+
+	if (margin == INT_MAX) {
+		duty = FAN_MAX_DUTY_CYCLE;
+	}
+	else {
+		duty = fan_curve_duty(data, margin);
+
+		/* Only slow down once the temperature dropped by the hysteresis */
+		if (data->duty_target != 0xFF &&
+			duty < reg_val_to_duty_cycle(data->duty_target)) {
+			duty = max_t(int, duty, min_t(int, reg_val_to_duty_cycle(data->duty_target),
+									fan_curve_duty(data, margin + FAN_CONTROL_HYSTERESIS)));
+		}
+	}
+
+	status = omp800_fc_fan_write_duty(data, duty_cycle_to_reg_val(duty));
+	if (status < 0) {
+		dev_dbg(&client->dev, "reg %d, err %d\n", fan_reg[FAN_DUTY_CYCLE_PERCENTAGE], status);
+	}
+
+	DEBUG_PRINT("margin(%d) duty(%d)", margin, duty);
+
+reschedule:
+	schedule_delayed_work(&data->control_work, msecs_to_jiffies(data->control_interval));
+exit:
+	mutex_unlock(&data->update_lock);
+}
+
+static ssize_t fan_show_control(struct device *dev, struct device_attribute *da, char *buf)
 {
-	int index;
 	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_fc_fan_data *data = i2c_get_clientdata(client);
+	ssize_t len = 0;
+	int i;
 
-	index = (attr->index - TEMP_SHUTDOWN_MIN) % NUM_OF_THERMAL_PER_CARD;
-	return sprintf(buf, "%d\n", temp_shutdown_degree[index]);	
+	mutex_lock(&data->update_lock);
+
+	switch (attr->index) {
+	case FAN_CONTROL_MODE:
+		len = sprintf(buf, "%d\n", data->control_mode);
+		break;
+	case FAN_CONTROL_INTERVAL:
+		len = sprintf(buf, "%u\n", data->control_interval);
+		break;
+	case FAN_DUTY_RAMP_UP:
+		len = sprintf(buf, "%u\n", data->ramp_up);
+		break;
+	case FAN_DUTY_RAMP_DOWN:
+		len = sprintf(buf, "%u\n", data->ramp_down);
+		break;
+	case FAN_DUTY_RAMP_INTERVAL:
+		len = sprintf(buf, "%u\n", data->ramp_interval);
+		break;
+	case FAN_CONTROL_CURVE:
+		for (i = 0; i < data->num_points; i++) {
+			len += sprintf(buf + len, "%s%d:%u", i ? " " : "",
+						   data->curve[i].offset, data->curve[i].duty);
+		}
+		len += sprintf(buf + len, "\n");
+		break;
+	default:
+		break;
+	}
+
+	mutex_unlock(&data->update_lock);
+	return len;
 }
 
-static ssize_t temp_show_value(struct device *dev, struct device_attribute *da,
-			 char *buf)
+/* The curve is written as "<offset>:<duty> ...", offsets in degree C
+ * relative to the warning degree, strictly increasing.
+ */
+static int fan_parse_curve(const char *buf, struct fan_curve_point *curve)
+{
+	int num = 0, offset, duty, n;
+
+	while (*buf) {
+		buf = skip_spaces(buf);
+		if (!*buf) {
+			break;
+		}
+
+		if (num == FAN_CURVE_MAX_POINTS ||
+			sscanf(buf, "%d:%d%n", &offset, &duty, &n) != 2) {
+			return -EINVAL;
+		}
+
+		if (offset < -100 || offset > 100 || duty < 0 || duty > FAN_MAX_DUTY_CYCLE ||
+			(num && offset <= curve[num-1].offset)) {
+			return -EINVAL;
+		}
+
+		curve[num].offset = offset;
+		curve[num].duty   = duty;
+		num++;
+		buf += n;
+	}
+
+	return num ? num : -EINVAL;
+}
+
+static ssize_t fan_set_control(struct device *dev, struct device_attribute *da,
+			const char *buf, size_t count)
 {
 	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
-	struct omp800_fc_fan_data *data = omp800_fc_fan_update_temp(dev);
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_fc_fan_data *data = i2c_get_clientdata(client);
+	struct fan_curve_point curve[FAN_CURVE_MAX_POINTS];
+	int error, value;
+
+	if (attr->index == FAN_CONTROL_CURVE) {
+		value = fan_parse_curve(buf, curve);
+		if (value < 0) {
+			return value;
+		}
+
+		mutex_lock(&data->update_lock);
+		memcpy(data->curve, curve, value * sizeof(curve[0]));
+		data->num_points = value;
+		mutex_unlock(&data->update_lock);
+		return count;
+	}
+
+	error = kstrtoint(buf, 10, &value);
+	if (error) {
+		return error;
+	}
+
+	switch (attr->index) {
+	case FAN_CONTROL_INTERVAL:
+		if (value < 100 || value > 60000) {
+			return -EINVAL;
+		}
+
+		mutex_lock(&data->update_lock);
+		data->control_interval = value;
+		mutex_unlock(&data->update_lock);
+		break;
+	case FAN_DUTY_RAMP_UP:
+	case FAN_DUTY_RAMP_DOWN:
+		if (value < 0 || value > FAN_DUTY_CYCLE_REG_MASK) {
+			return -EINVAL;
+		}
+
+		mutex_lock(&data->update_lock);
+		if (attr->index == FAN_DUTY_RAMP_UP) {
+			data->ramp_up = value;
+		}
+		else {
+			data->ramp_down = value;
+		}
+		mutex_unlock(&data->update_lock);
+		break;
+	case FAN_DUTY_RAMP_INTERVAL:
+		if (value < 0 || value > 10000) {
+			return -EINVAL;
+		}
+
+		mutex_lock(&data->update_lock);
+		data->ramp_interval = value;
+		mutex_unlock(&data->update_lock);
+		break;
+	case FAN_CONTROL_MODE:
+		if (value != FAN_CONTROL_MANUAL && value != FAN_CONTROL_AUTO) {
+			return -EINVAL;
+		}
+
+		mutex_lock(&data->update_lock);
+		data->control_mode = value;
+		mutex_unlock(&data->update_lock);
+
+		if (value == FAN_CONTROL_AUTO) {
+			mod_delayed_work(system_wq, &data->control_work, 0);
+		}
+		else {
+			cancel_delayed_work_sync(&data->control_work);
+		}
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return count;
+}
+
+static int omp800_fc_fan_tz_get_temp(struct thermal_zone_device *tzd, int *temp)
+{
+	struct fan_thermal_zone *zone = tzd->devdata;
+	struct omp800_fc_fan_data *data = zone->data;
+	int ret = 0;
 
 	if (!data->enable) {
-		//DEBUG_PRINT("Fan board is disabled");
-		return sprintf(buf, "0\n");
+		return -EAGAIN;
 	}
 
+	omp800_fc_fan_update_temp(&data->client->dev);
+
+	mutex_lock(&data->temp_update_lock);
+
+	/* -EAGAIN keeps the thermal core quiet about empty slots */
 	if (!data->temp_valid) {
-		return -EIO;
+		ret = -EIO;
+	}
+	else if (!(data->temp_present & BIT(zone->index / NUM_OF_THERMAL_PER_CARD))) {
+		ret = -EAGAIN;
+	}
+	else {
+		*temp = (s8)data->temp_reg_val[zone->index] * 1000;
+	}
+
+	mutex_unlock(&data->temp_update_lock);
+	return ret;
+}
+
+static int omp800_fc_fan_tz_get_trip_type(struct thermal_zone_device *tzd, int trip,
+										  enum thermal_trip_type *type)
+{
+	switch (trip) {
+	case FAN_TZ_TRIP_PASSIVE:
+		*type = THERMAL_TRIP_PASSIVE;
+		break;
+	case FAN_TZ_TRIP_CRITICAL:
+		*type = THERMAL_TRIP_CRITICAL; /* The thermal core powers off orderly */
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int omp800_fc_fan_tz_get_trip_temp(struct thermal_zone_device *tzd, int trip, int *temp)
+{
+	struct fan_thermal_zone *zone = tzd->devdata;
+	int n = zone->index % NUM_OF_THERMAL_PER_CARD;
+
+	switch (trip) {
+	case FAN_TZ_TRIP_PASSIVE:
+		*temp = temp_warning_degree[n];
+		break;
+	case FAN_TZ_TRIP_CRITICAL:
+		*temp = temp_shutdown_degree[n];
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int omp800_fc_fan_tz_bind(struct thermal_zone_device *tzd,
+								 struct thermal_cooling_device *cdev)
+{
+	struct fan_thermal_zone *zone = tzd->devdata;
+
+	if (cdev != zone->data->cdev) {
+		return 0;
+	}
+
+	return thermal_zone_bind_cooling_device(tzd, FAN_TZ_TRIP_PASSIVE, cdev,
+											THERMAL_NO_LIMIT, THERMAL_NO_LIMIT,
+											THERMAL_WEIGHT_DEFAULT);
+}
+
+static int omp800_fc_fan_tz_unbind(struct thermal_zone_device *tzd,
+								   struct thermal_cooling_device *cdev)
+{
+	struct fan_thermal_zone *zone = tzd->devdata;
+
+	if (cdev != zone->data->cdev) {
+		return 0;
+	}
+
+	return thermal_zone_unbind_cooling_device(tzd, FAN_TZ_TRIP_PASSIVE, cdev);
+}
+
+static struct thermal_zone_device_ops omp800_fc_fan_tz_ops = {
+	.get_temp	   = omp800_fc_fan_tz_get_temp,
+	.get_trip_type = omp800_fc_fan_tz_get_trip_type,
+	.get_trip_temp = omp800_fc_fan_tz_get_trip_temp,
+	.bind		   = omp800_fc_fan_tz_bind,
+	.unbind		   = omp800_fc_fan_tz_unbind,
+};
+
+/* The cooling states are the 16 values of the duty register, the state
+ * is a floor under the duty cycle set by manual or auto control.
+ */
+static int omp800_fc_fan_get_max_state(struct thermal_cooling_device *cdev, unsigned long *state)
+{
+	*state = FAN_DUTY_CYCLE_REG_MASK;
+	return 0;
+}
+
+static int omp800_fc_fan_get_cur_state(struct thermal_cooling_device *cdev, unsigned long *state)
+{
+	struct omp800_fc_fan_data *data = cdev->devdata;
+
+	*state = data->cooling_state;
+	return 0;
+}
+
+static int omp800_fc_fan_set_cur_state(struct thermal_cooling_device *cdev, unsigned long state)
+{
+	struct omp800_fc_fan_data *data = cdev->devdata;
+	int status = 0;
+
+	if (state > FAN_DUTY_CYCLE_REG_MASK) {
+		return -EINVAL;
+	}
+
+	mutex_lock(&data->update_lock);
+
+	data->cooling_state = state;
+
+	if (!data->enable) {
+		goto exit;
+	}
+
+	/* Nobody asked for a duty cycle yet, keep the one set by the hardware */
+	if (data->duty_target == 0xFF) {
+		status = omp800_fc_fan_read_value(data->client, fan_reg[FAN_DUTY_CYCLE_PERCENTAGE]);
+		if (status < 0) {
+			goto exit;
+		}
+
+		data->duty_target = data->duty_reg = status & FAN_DUTY_CYCLE_REG_MASK;
+	}
+
+	status = omp800_fc_fan_write_duty(data, data->duty_target);
+
+exit:
+	mutex_unlock(&data->update_lock);
+	return (status < 0) ? status : 0;
+}
+
+static const struct thermal_cooling_device_ops omp800_fc_fan_cooling_ops = {
+	.get_max_state = omp800_fc_fan_get_max_state,
+	.get_cur_state = omp800_fc_fan_get_cur_state,
+	.set_cur_state = omp800_fc_fan_set_cur_state,
+};
+
+static void omp800_fc_fan_unregister_thermal(struct omp800_fc_fan_data *data)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(data->zones); i++) {
+		if (data->zones[i].tzd) {
+			thermal_zone_device_unregister(data->zones[i].tzd);
+			data->zones[i].tzd = NULL;
+		}
+	}
+
+	if (data->cdev) {
+		thermal_cooling_device_unregister(data->cdev);
+		data->cdev = NULL;
+	}
+}
+
+/* The hwmon attributes keep working without the thermal framework, a
+ * registration failure is not fatal.
+ */
+static void omp800_fc_fan_register_thermal(struct omp800_fc_fan_data *data)
+{
+	struct i2c_client *client = data->client;
+	char name[THERMAL_NAME_LENGTH];
+	int i;
+
+	snprintf(name, sizeof(name), "omp800_fan%d", i2c_adapter_id(client->adapter));
+	data->cdev = thermal_cooling_device_register(name, data, &omp800_fc_fan_cooling_ops);
+	if (IS_ERR(data->cdev)) {
+		dev_warn(&client->dev, "cooling device, err %ld\n", PTR_ERR(data->cdev));
+		data->cdev = NULL;
+		return;
 	}
 
-	//DEBUG_PRINT("temperature = (%d)", (s8)data->temp_reg_val[attr->index - TEMP_INPUT_MIN]);
-	return sprintf(buf, "%d\n", (s8)data->temp_reg_val[attr->index - TEMP_INPUT_MIN] * 1000);
+	for (i = 0; i < ARRAY_SIZE(data->zones); i++) {
+		struct fan_thermal_zone *zone = &data->zones[i];
+		struct thermal_zone_device *tzd;
+
+		zone->data	= data;
+		zone->index = i;
+
+		snprintf(name, sizeof(name), "omp800_%d_%s_t%d", i2c_adapter_id(client->adapter),
+				 card_name[i / NUM_OF_THERMAL_PER_CARD], i % NUM_OF_THERMAL_PER_CARD + 1);
+		tzd = thermal_zone_device_register(name, FAN_TZ_NUM_TRIPS, 0, zone,
+										   &omp800_fc_fan_tz_ops, NULL,
+										   FAN_TZ_PASSIVE_DELAY, FAN_TZ_POLLING_DELAY);
+		if (IS_ERR(tzd)) {
+			dev_warn(&client->dev, "thermal zone %s, err %ld\n", name, PTR_ERR(tzd));
+			omp800_fc_fan_unregister_thermal(data);
+			return;
+		}
+
+		zone->tzd = tzd;
+	}
 }
 
 static int omp800_fc_is_fabriccard(u8 cpld_val)
@@ -670,19 +2413,23 @@ static int omp800_fc_fan_probe(struct i2c_client *client,
 			const struct i2c_device_id *dev_id)
 {
 	struct omp800_fc_fan_data *data;
-	int status;
+	int i, status;
 
-	/* Check if we sit on FabricCard CPU-A */
+	/* Check if we sit on the FabricCard, CPU-A and CPU-B both bind and
+	 * follow the control ownership tracked by the CPLD driver
+	 */
 	status = omp800_cpld_read(0x60, 0x2);
 	if (status < 0) {
 		//DEBUG_PRINT("cpld(0x60) reg(0x2) err %d", status);
 		return -EIO;
 	}
 
-	if (!omp800_fc_is_fabriccard(status) || (omp800_fc_cpu_id(status) != 0)) {
+	if (!omp800_fc_is_fabriccard(status)) {
 		return -ENXIO;
 	}
 
+	dev_dbg(&client->dev, "on CPU-%c\n", omp800_fc_cpu_id(status) ? 'B' : 'A');
+
 	if (!i2c_check_functionality(client->adapter, I2C_FUNC_SMBUS_BYTE_DATA)) {
 		status = -EIO;
 		goto exit;
@@ -695,30 +2442,92 @@ static int omp800_fc_fan_probe(struct i2c_client *client,
 	}
 
 	i2c_set_clientdata(client, data);
+	data->client = client;
 	mutex_init(&data->update_lock);
 	mutex_init(&data->temp_update_lock);
+	INIT_DELAYED_WORK(&data->control_work, omp800_fc_fan_control);
+	data->control_mode	   = FAN_CONTROL_MANUAL;
+	data->control_interval = FAN_CONTROL_DEFAULT_INTERVAL;
+	data->duty_reg		   = 0xFF;
+	data->duty_target	   = 0xFF;
+	data->duty_goal		   = 0xFF;
+	INIT_DELAYED_WORK(&data->duty_work, omp800_fc_fan_duty_ramp);
+	data->ramp_up		   = FAN_DEFAULT_RAMP_UP;
+	data->ramp_down		   = FAN_DEFAULT_RAMP_DOWN;
+	data->ramp_interval	   = FAN_DEFAULT_RAMP_INTERVAL;
+	data->duty_last_write  = jiffies;
+	data->num_points	   = ARRAY_SIZE(fan_default_curve);
+	memcpy(data->curve, fan_default_curve, sizeof(fan_default_curve));
+	INIT_DELAYED_WORK(&data->health_work, omp800_fc_fan_health_refresh);
+	INIT_DELAYED_WORK(&data->protect_work, omp800_fc_fan_protect_sweep);
+	data->protect_hold = FAN_PROTECT_DEFAULT_HOLD;
+	data->health_interval  = FAN_HEALTH_DEFAULT_INTERVAL;
+	data->sample_interval[FAN_SAMPLE_PRESENT] = FAN_SAMPLE_DEFAULT_PRESENT_INTERVAL;
+	data->sample_interval[FAN_SAMPLE_SPEED]	  = FAN_SAMPLE_DEFAULT_SPEED_INTERVAL;
+	data->temp_interval	   = FAN_SAMPLE_DEFAULT_TEMP_INTERVAL;
+
+	for (i = 0; i < NUM_OF_ROTOR; i++) {
+		data->health[i]		 = 1000;
+		data->peer_health[i] = 1000;
+	}
+
+	for (i = 0; i < NUM_OF_FAN; i++) {
+		data->balance[i] = 1000;
+	}
 	
 	dev_info(&client->dev, "chip found\n");
 
+	status = omp800_fc_fan_attr_build(data);
+	if (status) {
+		goto exit_free;
+	}
+
 	/* Register sysfs hooks */
 	status = sysfs_create_group(&client->dev.kobj, &omp800_fc_fan_group);
 	if (status) {
-		goto exit_free;
+		goto exit_free_attr;
+	}
+
+	status = sysfs_create_group(&client->dev.kobj, &data->dyn_group);
+	if (status) {
+		goto exit_remove;
+	}
+
+	status = sysfs_create_bin_file(&client->dev.kobj, &fan_health_history_attr);
+	if (status) {
+		goto exit_remove_dyn;
 	}
 
 	data->hwmon_dev = hwmon_device_register(&client->dev);
 	if (IS_ERR(data->hwmon_dev)) {
 		status = PTR_ERR(data->hwmon_dev);
-		goto exit_remove;
+		goto exit_remove_bin;
 	}
 
 	dev_info(&client->dev, "%s: fan '%s'\n",
 		 dev_name(data->hwmon_dev), client->name);
+
+	omp800_fc_fan_register_thermal(data);
+	schedule_delayed_work(&data->health_work, msecs_to_jiffies(data->health_interval));
+
+	mutex_lock(&fan_boards_lock);
+	list_add_tail(&data->list, &fan_boards);
+	mutex_unlock(&fan_boards_lock);
+
+	data->owner_nb.notifier_call = omp800_fc_fan_owner_event;
+	omp800_cpld_register_owner_notifier(&data->owner_nb);
+	omp800_fc_fan_set_owner(data, omp800_cpld_is_owner() > 0);
 	
 	return 0;
 
+exit_remove_bin:
+	sysfs_remove_bin_file(&client->dev.kobj, &fan_health_history_attr);
+exit_remove_dyn:
+	sysfs_remove_group(&client->dev.kobj, &data->dyn_group);
 exit_remove:
 	sysfs_remove_group(&client->dev.kobj, &omp800_fc_fan_group);
+exit_free_attr:
+	omp800_fc_fan_attr_free(data);
 exit_free:
 	kfree(data);
 exit:
@@ -729,8 +2538,39 @@ exit:
 static int omp800_fc_fan_remove(struct i2c_client *client)
 {
 	struct omp800_fc_fan_data *data = i2c_get_clientdata(client);
+
+	omp800_cpld_unregister_owner_notifier(&data->owner_nb);
+
+	mutex_lock(&fan_boards_lock);
+	list_del(&data->list);
+	mutex_unlock(&fan_boards_lock);
+
+	omp800_fc_fan_unregister_thermal(data);
 	hwmon_device_unregister(data->hwmon_dev);
+	sysfs_remove_bin_file(&client->dev.kobj, &fan_health_history_attr);
 	sysfs_remove_group(&client->dev.kobj, &omp800_fc_fan_group);
+
+	mutex_lock(&data->update_lock);
+	data->control_mode = FAN_CONTROL_MANUAL;
+	data->health_interval = 0;
+	mutex_unlock(&data->update_lock);
+	cancel_delayed_work_sync(&data->control_work);
+	cancel_delayed_work_sync(&data->health_work);
+
+	mutex_lock(&data->temp_update_lock);
+	data->protect = 0;
+	mutex_unlock(&data->temp_update_lock);
+	cancel_delayed_work_sync(&data->protect_work);
+	cancel_delayed_work_sync(&data->duty_work);
+
+	/* Readers of dyn_group may still queue a refresh until it is gone */
+	mutex_lock(&data->update_lock);
+	data->dyn_dead = 1;
+	mutex_unlock(&data->update_lock);
+	cancel_work_sync(&data->dyn_work);
+	sysfs_remove_group(&client->dev.kobj, &data->dyn_group);
+	cancel_work_sync(&data->dyn_work);
+	omp800_fc_fan_attr_free(data);
 	
 	return 0;
 }
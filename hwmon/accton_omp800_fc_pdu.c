@@ -27,6 +27,9 @@
 #include <linux/slab.h>
 #include <linux/delay.h>
 #include <linux/dmi.h>
+#include <linux/notifier.h>
+#include <linux/workqueue.h>
+#include <linux/kobject.h>
 
 #define DEBUG_MODE 0
 
@@ -44,29 +47,53 @@ static ssize_t show_pdu_present(struct device *dev, struct device_attribute *da,
 static ssize_t show_pdu(struct device *dev, struct device_attribute *da, char *buf);
 static ssize_t show_psu(struct device *dev, struct device_attribute *da, char *buf);
 static ssize_t psu_set_enable(struct device *dev, struct device_attribute *da, const char *buf, size_t count);
+static ssize_t show_psu_sample(struct device *dev, struct device_attribute *da, char *buf);
+static ssize_t set_psu_sample(struct device *dev, struct device_attribute *da, const char *buf, size_t count);
 static struct omp800_fc_pdu_data *omp800_fc_pdu_update_device(struct device *dev);
+static int omp800_fc_pdu_read_version(struct i2c_client *client, struct omp800_fc_pdu_data *data);
+static void omp800_fc_pdu_refresh(struct i2c_client *client, struct omp800_fc_pdu_data *data);
 extern int omp800_cpld_read(unsigned short cpld_addr, u8 reg);
+extern int omp800_cpld_present_status(void);
+extern int omp800_cpld_is_owner(void);
+extern int omp800_cpld_register_owner_notifier(struct notifier_block *nb);
+extern int omp800_cpld_unregister_owner_notifier(struct notifier_block *nb);
 
 /* Addresses scanned 
  */
 static const unsigned short normal_i2c[] = { I2C_CLIENT_END };
 
+/* PSU status sampler, changes of presence and input/output power good are
+ * signalled through sysfs_notify() and a KOBJ_CHANGE uevent.
+ */
+#define NUM_OF_PSU					3
+#define PSU_SAMPLE_DEFAULT_INTERVAL	1000 /* ms */
+#define PSU_STATE_PRESENT			0x1
+#define PSU_STATE_INPUT_POWER		0x2
+#define PSU_STATE_OUTPUT_POWER		0x4
+
 /* Each client has this additional data 
  */
 struct omp800_fc_pdu_data {
+	struct i2c_client  *client;
     struct device      *hwmon_dev;
     struct mutex        update_lock;
+	struct notifier_block owner_nb;		/* Follow the fan/PDU control ownership */
 	u8					enable;	   		/* Enable or Disable pdu board i2c access */
     char                valid;			/* !=0 if registers are valid */
     unsigned long       last_updated;	/* In jiffies */
 	u8					index;			/* PDU index */
 	u8					present;		/* PDU present status */
+	u8					version_valid;	/* != 0 if status[0] holds the version of this PDU */
 	u8 					status[5];		/* Register values 
 										   0: PDU version
 										   1: PSU present
 										   2: PSU input power
 										   3: PSU output power 
 										   4: PSU enable */
+	struct delayed_work sample_work;
+	unsigned int		sample_interval;	/* In ms, 0 = disabled */
+	u8					psu_state_valid;	/* != 0 if psu_state is valid */
+	u8					psu_state[NUM_OF_PSU];	/* PSU_STATE_* of the last sample */
 };
 
 #define PSU_ATTRIBUTES(ID) \
@@ -80,6 +107,7 @@ enum omp800_fc_psu_sysfs_attributes {
 	PDU_VERSION,
 	PDU_PRESENT,
 	PDU_ENABLE,
+	PSU_SAMPLE_INTERVAL,
 	PSU_ATTRIBUTES(1),
 	PSU_ATTRIBUTES(2),
 	PSU_ATTRIBUTES(3),
@@ -93,6 +121,7 @@ enum omp800_fc_psu_sysfs_attributes {
 static SENSOR_DEVICE_ATTR(pdu_enable,     S_IWUSR | S_IRUGO, pdu_show_enable, pdu_set_enable, PDU_ENABLE);
 static SENSOR_DEVICE_ATTR(pdu_version,    S_IRUGO, show_pdu, NULL, PDU_VERSION);
 static SENSOR_DEVICE_ATTR(pdu_is_present, S_IRUGO, show_pdu_present, NULL, PDU_PRESENT);
+static SENSOR_DEVICE_ATTR(psu_sample_interval, S_IWUSR | S_IRUGO, show_psu_sample, set_psu_sample, PSU_SAMPLE_INTERVAL);
 
 /* psu attributes */
 #define DECLARE_PSU_SENSOR_DEV_ATTR(id) \
@@ -114,6 +143,7 @@ static struct attribute *omp800_fc_pdu_attributes[] = {
     &sensor_dev_attr_pdu_version.dev_attr.attr,
     &sensor_dev_attr_pdu_is_present.dev_attr.attr,
     &sensor_dev_attr_pdu_enable.dev_attr.attr,
+    &sensor_dev_attr_psu_sample_interval.dev_attr.attr,
     DECLARE_PSU_ATTR(1),
     DECLARE_PSU_ATTR(2),
     DECLARE_PSU_ATTR(3),
@@ -141,6 +171,15 @@ static ssize_t pdu_set_enable(struct device *dev, struct device_attribute *da,
 	}
 
 	mutex_lock(&data->update_lock);
+
+	/* The other CPU drives the PDU while this one is on standby, checked
+	 * under update_lock so it cannot race with an ownership change.
+	 */
+	if (value && omp800_cpld_is_owner() == 0) {
+		mutex_unlock(&data->update_lock);
+		return -EBUSY;
+	}
+
 	data->enable = !!(value);
 	mutex_unlock(&data->update_lock);
 	
@@ -266,15 +305,28 @@ static ssize_t psu_set_enable(struct device *dev, struct device_attribute *da,
 	DEBUG_PRINT("PSU ID = (%d), mask = (0x%x)\r\n", psu_id, mask);
 
 	mutex_lock(&data->update_lock);
-	
-	status = i2c_smbus_read_byte_data(client, 0x14);
-	if (status < 0) {
-		goto exit;
+
+	/* status[4] shadows reg 0x14 while the cached data is valid,
+	 * only read it back when the shadow is stale.
+	 */
+	if (data->valid && data->present) {
+		status = data->status[4];
+	}
+	else {
+		status = i2c_smbus_read_byte_data(client, 0x14);
+		if (status < 0) {
+			goto exit;
+		}
 	}
 
 	enable = enable ? (status & ~mask) : (status | mask);
+	if (enable == status) {
+		goto exit;
+	}
+
 	status = i2c_smbus_write_byte_data(client, 0x14, enable);
 	if (status < 0) {
+		data->valid = 0;
 		goto exit;
 	}
 
@@ -286,6 +338,154 @@ exit:
 	return (status < 0) ? status : count;
 }
 
+/* Only the fabric card CPU owning the chassis control polls the PDU,
+ * pdu_enable is refused on the standby one.
+ */
+static int omp800_fc_pdu_owner_event(struct notifier_block *nb, unsigned long state, void *unused)
+{
+	struct omp800_fc_pdu_data *data = container_of(nb, struct omp800_fc_pdu_data, owner_nb);
+
+	mutex_lock(&data->update_lock);
+	data->enable = (omp800_cpld_is_owner() > 0);
+	data->valid	 = 0;
+	if (data->enable && data->sample_interval) {
+		mod_delayed_work(system_wq, &data->sample_work, 0);
+	}
+	mutex_unlock(&data->update_lock);
+
+	return NOTIFY_OK;
+}
+
+/* PSU_STATE_* of a PSU from the cached registers, called with update_lock held */
+static u8 omp800_fc_pdu_psu_state(struct omp800_fc_pdu_data *data, int psu_id)
+{
+	u8 mask = 1 << (7-psu_id);
+	u8 state = 0;
+
+	if (!data->present) {
+		return 0;
+	}
+
+	state |= (data->status[1] & mask) ? 0 : PSU_STATE_PRESENT;
+	state |= (data->status[2] & mask) ? 0 : PSU_STATE_INPUT_POWER;
+	state |= (data->status[3] & mask) ? 0 : PSU_STATE_OUTPUT_POWER;
+
+	return state;
+}
+
+static void omp800_fc_pdu_psu_event(struct omp800_fc_pdu_data *data, int psu_id, u8 state, u8 changed)
+{
+	struct kobject *kobj = &data->client->dev.kobj;
+	char name[32];
+	char event[4][32];
+	char *envp[] = { event[0], event[1], event[2], event[3], NULL };
+
+	if (changed & PSU_STATE_PRESENT) {
+		snprintf(name, sizeof(name), "psu%d_is_present", psu_id + 1);
+		sysfs_notify(kobj, NULL, name);
+	}
+
+	if (changed & PSU_STATE_INPUT_POWER) {
+		snprintf(name, sizeof(name), "psu%d_input_power_good", psu_id + 1);
+		sysfs_notify(kobj, NULL, name);
+	}
+
+	if (changed & PSU_STATE_OUTPUT_POWER) {
+		snprintf(name, sizeof(name), "psu%d_output_power_good", psu_id + 1);
+		sysfs_notify(kobj, NULL, name);
+	}
+
+	snprintf(event[0], sizeof(event[0]), "PSU=%d", psu_id + 1);
+	snprintf(event[1], sizeof(event[1]), "PSU_PRESENT=%d", !!(state & PSU_STATE_PRESENT));
+	snprintf(event[2], sizeof(event[2]), "PSU_INPUT_POWER_GOOD=%d", !!(state & PSU_STATE_INPUT_POWER));
+	snprintf(event[3], sizeof(event[3]), "PSU_OUTPUT_POWER_GOOD=%d", !!(state & PSU_STATE_OUTPUT_POWER));
+	kobject_uevent_env(kobj, KOBJ_CHANGE, envp);
+}
+
+static void omp800_fc_pdu_sample(struct work_struct *work)
+{
+	struct omp800_fc_pdu_data *data = container_of(to_delayed_work(work),
+												   struct omp800_fc_pdu_data, sample_work);
+	u8 state[NUM_OF_PSU], changed[NUM_OF_PSU] = { 0 };
+	unsigned int interval;
+	int i;
+
+	mutex_lock(&data->update_lock);
+
+	/* The only bus access while sampling, readers never refresh on their
+	 * own (see omp800_fc_pdu_update_device). Nothing is known while on
+	 * standby or after a failed refresh, keep the last sample to diff
+	 * against.
+	 */
+	if (data->enable) {
+		omp800_fc_pdu_refresh(data->client, data);
+	}
+
+	if (data->enable && data->valid) {
+		for (i = 0; i < NUM_OF_PSU; i++) {
+			state[i] = omp800_fc_pdu_psu_state(data, i);
+			if (data->psu_state_valid) {
+				changed[i] = state[i] ^ data->psu_state[i];
+			}
+			data->psu_state[i] = state[i];
+		}
+
+		data->psu_state_valid = 1;
+	}
+
+	interval = data->sample_interval;
+	mutex_unlock(&data->update_lock);
+
+	for (i = 0; i < NUM_OF_PSU; i++) {
+		if (changed[i]) {
+			omp800_fc_pdu_psu_event(data, i, state[i], changed[i]);
+		}
+	}
+
+	if (interval) {
+		schedule_delayed_work(&data->sample_work, msecs_to_jiffies(interval));
+	}
+}
+
+static ssize_t show_psu_sample(struct device *dev, struct device_attribute *da, char *buf)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_fc_pdu_data *data = i2c_get_clientdata(client);
+
+	return sprintf(buf, "%u\n", data->sample_interval);
+}
+
+static ssize_t set_psu_sample(struct device *dev, struct device_attribute *da,
+			const char *buf, size_t count)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct omp800_fc_pdu_data *data = i2c_get_clientdata(client);
+	unsigned int interval;
+	int error;
+
+	error = kstrtouint(buf, 10, &interval);
+	if (error) {
+		return error;
+	}
+
+	if (interval && (interval < 100 || interval > 60000)) {
+		return -EINVAL;
+	}
+
+	mutex_lock(&data->update_lock);
+	data->sample_interval = interval;
+	mutex_unlock(&data->update_lock);
+
+	if (interval) {
+		mod_delayed_work(system_wq, &data->sample_work, 0);
+	}
+	else {
+		cancel_delayed_work_sync(&data->sample_work);
+	}
+
+	return count;
+}
+
 static const struct attribute_group omp800_fc_psu_group = {
     .attrs = omp800_fc_pdu_attributes,
 };
@@ -306,17 +506,21 @@ static int omp800_fc_pdu_probe(struct i2c_client *client,
     struct omp800_fc_pdu_data *data;
     int status;
 
-	/* Check if we sit on FabricCard CPU-A */
+	/* Check if we sit on the FabricCard, CPU-A and CPU-B both bind and
+	 * follow the control ownership tracked by the CPLD driver
+	 */
 	status = omp800_cpld_read(0x60, 0x2);
 	if (status < 0) {
 		DEBUG_PRINT("cpld(0x60) reg(0x2) err %d", status);
 		return -EIO;
 	}
 
-	if (!omp800_fc_is_fabriccard(status) || (omp800_fc_cpu_id(status) != 0)) {
+	if (!omp800_fc_is_fabriccard(status)) {
 		return -ENXIO;
 	}
 
+	DEBUG_PRINT("CPU ID = (%d)", omp800_fc_cpu_id(status));
+
     if (!i2c_check_functionality(client->adapter, I2C_FUNC_SMBUS_BYTE_DATA)) {
 		DEBUG_PRINT("I2C_FUNC_SMBUS_BYTE_DATA not supported");
         return -EIO;
@@ -328,10 +532,13 @@ static int omp800_fc_pdu_probe(struct i2c_client *client,
     }
 
     i2c_set_clientdata(client, data);
+	data->client = client;
     data->valid  = 0;
 	data->enable = 0;
 	data->index  = dev_id->driver_data;
     mutex_init(&data->update_lock);
+	INIT_DELAYED_WORK(&data->sample_work, omp800_fc_pdu_sample);
+	data->sample_interval = PSU_SAMPLE_DEFAULT_INTERVAL;
 
     dev_info(&client->dev, "chip found\n");
 
@@ -349,6 +556,19 @@ static int omp800_fc_pdu_probe(struct i2c_client *client,
 
     dev_info(&client->dev, "%s: psu '%s'\n",
          dev_name(data->hwmon_dev), client->name);
+
+	/* Cache the version now if the PDU board is already there */
+	status = omp800_cpld_present_status();
+	if (status >= 0 && !(status & 0x20)) {
+		mutex_lock(&data->update_lock);
+		omp800_fc_pdu_read_version(client, data);
+		mutex_unlock(&data->update_lock);
+	}
+
+	data->owner_nb.notifier_call = omp800_fc_pdu_owner_event;
+	omp800_cpld_register_owner_notifier(&data->owner_nb);
+	omp800_fc_pdu_owner_event(&data->owner_nb, 0, NULL);
+	schedule_delayed_work(&data->sample_work, 0);
     
     return 0;
 
@@ -364,6 +584,13 @@ static int omp800_fc_pdu_remove(struct i2c_client *client)
 {
     struct omp800_fc_pdu_data *data = i2c_get_clientdata(client);
 
+	omp800_cpld_unregister_owner_notifier(&data->owner_nb);
+
+	mutex_lock(&data->update_lock);
+	data->sample_interval = 0;
+	mutex_unlock(&data->update_lock);
+	cancel_delayed_work_sync(&data->sample_work);
+
     hwmon_device_unregister(data->hwmon_dev);
     sysfs_remove_group(&client->dev.kobj, &omp800_fc_psu_group);
     kfree(data);
@@ -401,10 +628,100 @@ static struct i2c_driver omp800_fc_pdu_driver = {
     .address_list = normal_i2c,
 };
 
-struct reg_data_byte {
-	u8  reg;
-	u8 *value;
-};
+/* PDU status registers 0x10 ~ 0x14, fetched with one block read. 0x13
+ * is not used.
+ */
+#define PDU_STATUS_REG_BEGIN	0x10
+#define PDU_STATUS_REG_NUM		5
+
+static int omp800_fc_pdu_read_status(struct i2c_client *client, u8 *values)
+{
+	int i, status;
+
+	if (i2c_check_functionality(client->adapter, I2C_FUNC_SMBUS_READ_I2C_BLOCK)) {
+		status = i2c_smbus_read_i2c_block_data(client, PDU_STATUS_REG_BEGIN,
+											   PDU_STATUS_REG_NUM, values);
+		if (status < 0) {
+			return status;
+		}
+
+		return (status == PDU_STATUS_REG_NUM) ? 0 : -EIO;
+	}
+
+	for (i = 0; i < PDU_STATUS_REG_NUM; i++) {
+		status = i2c_smbus_read_byte_data(client, PDU_STATUS_REG_BEGIN + i);
+		if (status < 0) {
+			return status;
+		}
+
+		values[i] = status;
+	}
+
+	return 0;
+}
+
+/* The version is static, it is only read again once the PDU board was
+ * seen absent, i.e. may have been replaced.
+ */
+static int omp800_fc_pdu_read_version(struct i2c_client *client, struct omp800_fc_pdu_data *data)
+{
+	int status = i2c_smbus_read_byte_data(client, 0x01);
+
+	if (status < 0) {
+		return status;
+	}
+
+	data->status[0]		= status;
+	data->version_valid = 1;
+
+	return 0;
+}
+
+/* Fetch presence and status, called with update_lock held */
+static void omp800_fc_pdu_refresh(struct i2c_client *client, struct omp800_fc_pdu_data *data)
+{
+	int status;
+	u8 values[PDU_STATUS_REG_NUM];
+
+	data->valid = 0;
+	data->present = 0;
+	dev_dbg(&client->dev, "Starting omp800_fc_pdu update\n");
+	/* Check if PDU board is present, from the CPLD status sample */
+	status = omp800_cpld_present_status();
+	if (status < 0) {
+		DEBUG_PRINT("cpld(0x60) reg(0x48) err %d", status);
+		return;
+	}
+
+	data->present = !(status & 0x20);
+	if (!data->present) {
+		data->version_valid = 0;
+	}
+
+	if (data->present) {
+		if (!data->version_valid) {
+			status = omp800_fc_pdu_read_version(client, data);
+			if (status < 0) {
+				dev_dbg(&client->dev, "reg %d, err %d\n", 0x01, status);
+				return;
+			}
+		}
+
+		status = omp800_fc_pdu_read_status(client, values);
+		if (status < 0) {
+			dev_dbg(&client->dev, "reg %d, err %d\n", PDU_STATUS_REG_BEGIN, status);
+			return;
+		}
+
+		data->status[1] = values[0x10 - PDU_STATUS_REG_BEGIN];
+		data->status[2] = values[0x11 - PDU_STATUS_REG_BEGIN];
+		data->status[3] = values[0x12 - PDU_STATUS_REG_BEGIN];
+		data->status[4] = values[0x14 - PDU_STATUS_REG_BEGIN];
+	}
+
+	data->last_updated = jiffies;
+	data->valid = 1;
+}
 
 static struct omp800_fc_pdu_data *omp800_fc_pdu_update_device(struct device *dev)
 {
@@ -417,47 +734,14 @@ static struct omp800_fc_pdu_data *omp800_fc_pdu_update_device(struct device *dev
 
     mutex_lock(&data->update_lock);
 
-    if (time_after(jiffies, data->last_updated + HZ + HZ / 2)
-        || !data->valid) {
-        int status, i;
-		struct reg_data_byte regs_byte[] = { {0x01, &data->status[0]},
-											 {0x10, &data->status[1]},
-											 {0x11, &data->status[2]},
-											 {0x12, &data->status[3]},
-											 {0x14, &data->status[4]}};
-
-		data->valid = 0;
-		data->present = 0;
-        dev_dbg(&client->dev, "Starting omp800_fc_pdu update\n");
-		/* Check if PDU board is present */
-		status = omp800_cpld_read(0x60, 0x48);
-		if (status < 0) {
-			DEBUG_PRINT("cpld(0x60) reg(0x48) err %d", status);
-			goto exit;
-		}
-
-		data->present = !(status & 0x20);
-	
-		/* Read byte data */
-		if (data->present) {
-			for (i = 0; i < ARRAY_SIZE(regs_byte); i++) {
-				status = i2c_smbus_read_byte_data(client, regs_byte[i].reg);
-
-				if (status < 0) {
-					dev_dbg(&client->dev, "reg %d, err %d\n", regs_byte[i].reg, status);
-					goto exit;
-				}
-				else {
-					*(regs_byte[i].value) = status;
-				}
-			}
-		}
-
-        data->last_updated = jiffies;
-        data->valid = 1;
+	/* While the sampler runs it is the only one going to the bus, readers
+	 * are served from its last sample.
+	 */
+    if (!data->sample_interval &&
+        (time_after(jiffies, data->last_updated + HZ + HZ / 2) || !data->valid)) {
+		omp800_fc_pdu_refresh(client, data);
     }
 
-exit:
     mutex_unlock(&data->update_lock);
 
     return data;
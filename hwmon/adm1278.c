@@ -27,6 +27,8 @@
 #include <linux/slab.h>
 #include <linux/delay.h>
 #include <linux/dmi.h>
+#include <linux/list.h>
+#include <linux/math64.h>
 
 #define DEBUG_MODE 0
 
@@ -40,6 +42,12 @@
 static ssize_t show_hot_swap(struct device *dev, struct device_attribute *da, char *buf);
 static ssize_t set_hot_swap(struct device *dev, struct device_attribute *da,
 			const char *buf, size_t count);
+static ssize_t show_name(struct device *dev, struct device_attribute *da, char *buf);
+static ssize_t show_label(struct device *dev, struct device_attribute *da, char *buf);
+static ssize_t show_telemetry(struct device *dev, struct device_attribute *da, char *buf);
+static ssize_t show_config(struct device *dev, struct device_attribute *da, char *buf);
+static ssize_t set_config(struct device *dev, struct device_attribute *da,
+			const char *buf, size_t count);
 
 /*
  * OPERATION
@@ -47,6 +55,66 @@ static ssize_t set_hot_swap(struct device *dev, struct device_attribute *da,
 #define PB_OPERATION_OFFSET				0x01
 #define PB_OPERATION_CONTROL_ON         0x80
 
+/*
+ * Telemetry, all in DIRECT format: X = (Y * 10^-R - b) / m
+ */
+#define PB_READ_VIN						0x88
+#define PB_READ_VOUT					0x8B
+#define PB_READ_IOUT					0x8C
+#define PB_READ_TEMPERATURE_1			0x8D
+#define PB_READ_PIN						0x97
+
+/*
+ * PMON_CONFIG, VOUT and TEMP1 sampling are off after power-up
+ */
+#define ADM1278_PMON_CONFIG				0xD4
+#define ADM1278_VOUT_EN					BIT(1)
+#define ADM1278_TEMP1_EN				BIT(3)
+
+#define ADM1278_DEFAULT_INTERVAL		1000 /* ms */
+
+/* The sense resistor is board specific and x86_64_accton_omp800_fc_r0_init.sh
+ * does not provide it, so current and power stay unavailable until
+ * shunt_resistor is written.
+ */
+#define ADM1278_DEFAULT_RSENSE			0 /* micro-ohm, 0 if unknown */
+
+enum adm1278_sensor {
+	ADM1278_VIN,
+	ADM1278_VOUT,
+	ADM1278_IOUT,
+	ADM1278_PIN,
+	ADM1278_TEMP,
+	ADM1278_NUM_SENSORS
+};
+
+/* Coefficients of the 60V range, m of current and power is per mOhm of
+ * sense resistor.
+ */
+struct adm1278_coefficient {
+	u8	 reg;
+	int	 m;
+	int	 b;
+	int	 R;
+	int	 scale;		/* hwmon unit per chip unit (V, A, W, degree C) */
+	u8	 rsense;	/* != 0 if m scales with the sense resistor */
+	const char *label;
+};
+
+static const struct adm1278_coefficient adm1278_coefficients[ADM1278_NUM_SENSORS] = {
+	[ADM1278_VIN]  = { PB_READ_VIN,			  19599,	 0, -2,	   1000, 0, "vin" },	/* mV */
+	[ADM1278_VOUT] = { PB_READ_VOUT,		  19599,	 0, -2,	   1000, 0, "vout" },	/* mV */
+	[ADM1278_IOUT] = { PB_READ_IOUT,			800, 20475, -1,	   1000, 1, "iout" },	/* mA */
+	[ADM1278_PIN]  = { PB_READ_PIN,			   6123,	 0, -2, 1000000, 1, "pin" },	/* uW */
+	[ADM1278_TEMP] = { PB_READ_TEMPERATURE_1,	 42, 31880, -1,	   1000, 0, "temp1" },	/* m degree C */
+};
+
+enum adm1278_sysfs_attributes {
+	ADM1278_HOT_SWAP,
+	ADM1278_UPDATE_INTERVAL,
+	ADM1278_SHUNT_RESISTOR
+};
+
 /* Addresses scanned 
  */
 static const unsigned short normal_i2c[] = { I2C_CLIENT_END };
@@ -55,14 +123,51 @@ static const unsigned short normal_i2c[] = { I2C_CLIENT_END };
  */
 struct adm1278_data {
     struct device      *hwmon_dev;
+    struct i2c_client  *client;
+    struct list_head    list;       /* In adm1278_clients */
+    struct mutex        update_lock;
+    char                valid;          /* != 0 if registers are valid */
+    unsigned long       last_updated;   /* In jiffies */
+    unsigned int        interval;       /* In ms, lifetime of the cached registers */
+    unsigned int        rsense;         /* Sense resistor in micro-ohm */
+    u16                 regs[ADM1278_NUM_SENSORS];
 };
 
+/* All bound controllers, for adm1278_set_hot_swap()
+ */
+static LIST_HEAD(adm1278_clients);
+static DEFINE_MUTEX(adm1278_clients_lock);
+
 /* sysfs attributes for hwmon 
  */
-static SENSOR_DEVICE_ATTR(hot_swap_on, S_IWUSR | S_IRUGO, show_hot_swap, set_hot_swap, 0);
+static SENSOR_DEVICE_ATTR(hot_swap_on, S_IWUSR | S_IRUGO, show_hot_swap, set_hot_swap, ADM1278_HOT_SWAP);
+static SENSOR_DEVICE_ATTR(name, S_IRUGO, show_name, NULL, 0);
+static SENSOR_DEVICE_ATTR(update_interval, S_IWUSR | S_IRUGO, show_config, set_config, ADM1278_UPDATE_INTERVAL);
+static SENSOR_DEVICE_ATTR(shunt_resistor, S_IWUSR | S_IRUGO, show_config, set_config, ADM1278_SHUNT_RESISTOR);
+static SENSOR_DEVICE_ATTR(in1_input, S_IRUGO, show_telemetry, NULL, ADM1278_VIN);
+static SENSOR_DEVICE_ATTR(in1_label, S_IRUGO, show_label, NULL, ADM1278_VIN);
+static SENSOR_DEVICE_ATTR(in2_input, S_IRUGO, show_telemetry, NULL, ADM1278_VOUT);
+static SENSOR_DEVICE_ATTR(in2_label, S_IRUGO, show_label, NULL, ADM1278_VOUT);
+static SENSOR_DEVICE_ATTR(curr1_input, S_IRUGO, show_telemetry, NULL, ADM1278_IOUT);
+static SENSOR_DEVICE_ATTR(curr1_label, S_IRUGO, show_label, NULL, ADM1278_IOUT);
+static SENSOR_DEVICE_ATTR(power1_input, S_IRUGO, show_telemetry, NULL, ADM1278_PIN);
+static SENSOR_DEVICE_ATTR(power1_label, S_IRUGO, show_label, NULL, ADM1278_PIN);
+static SENSOR_DEVICE_ATTR(temp1_input, S_IRUGO, show_telemetry, NULL, ADM1278_TEMP);
 
 static struct attribute *adm1278_attributes[] = {
     &sensor_dev_attr_hot_swap_on.dev_attr.attr,
+    &sensor_dev_attr_name.dev_attr.attr,
+    &sensor_dev_attr_update_interval.dev_attr.attr,
+    &sensor_dev_attr_shunt_resistor.dev_attr.attr,
+    &sensor_dev_attr_in1_input.dev_attr.attr,
+    &sensor_dev_attr_in1_label.dev_attr.attr,
+    &sensor_dev_attr_in2_input.dev_attr.attr,
+    &sensor_dev_attr_in2_label.dev_attr.attr,
+    &sensor_dev_attr_curr1_input.dev_attr.attr,
+    &sensor_dev_attr_curr1_label.dev_attr.attr,
+    &sensor_dev_attr_power1_input.dev_attr.attr,
+    &sensor_dev_attr_power1_label.dev_attr.attr,
+    &sensor_dev_attr_temp1_input.dev_attr.attr,
     NULL
 };
 
@@ -106,6 +211,219 @@ static ssize_t set_hot_swap(struct device *dev, struct device_attribute *da,
 	return count;
 }
 
+/* Read all telemetry registers in one burst: a single combined transfer
+ * of command/word pairs when the adapter can do plain I2C, one SMBus word
+ * read per register otherwise.
+ */
+static int adm1278_read_telemetry(struct i2c_client *client, u16 *regs)
+{
+	struct i2c_msg msgs[ADM1278_NUM_SENSORS * 2];
+	u8 cmds[ADM1278_NUM_SENSORS];
+	u8 values[ADM1278_NUM_SENSORS][2];
+	int i, status;
+
+	if (!i2c_check_functionality(client->adapter, I2C_FUNC_I2C)) {
+		for (i = 0; i < ADM1278_NUM_SENSORS; i++) {
+			status = i2c_smbus_read_word_data(client, adm1278_coefficients[i].reg);
+			if (status < 0) {
+				return status;
+			}
+
+			regs[i] = status;
+		}
+
+		return 0;
+	}
+
+	for (i = 0; i < ADM1278_NUM_SENSORS; i++) {
+		cmds[i] = adm1278_coefficients[i].reg;
+
+		msgs[i*2].addr	  = client->addr;
+		msgs[i*2].flags	  = 0;
+		msgs[i*2].len	  = 1;
+		msgs[i*2].buf	  = &cmds[i];
+		msgs[i*2+1].addr  = client->addr;
+		msgs[i*2+1].flags = I2C_M_RD;
+		msgs[i*2+1].len	  = 2;
+		msgs[i*2+1].buf	  = values[i];
+	}
+
+	status = i2c_transfer(client->adapter, msgs, ARRAY_SIZE(msgs));
+	if (status < 0) {
+		return status;
+	}
+
+	if (status != ARRAY_SIZE(msgs)) {
+		return -EIO;
+	}
+
+	for (i = 0; i < ADM1278_NUM_SENSORS; i++) {
+		regs[i] = values[i][0] | (values[i][1] << 8);
+	}
+
+	return 0;
+}
+
+static struct adm1278_data *adm1278_update_device(struct device *dev)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct adm1278_data *data = i2c_get_clientdata(client);
+	u16 regs[ADM1278_NUM_SENSORS];
+	int status;
+
+	mutex_lock(&data->update_lock);
+
+	if (time_after(jiffies, data->last_updated + msecs_to_jiffies(data->interval)) ||
+		!data->valid) {
+		dev_dbg(&client->dev, "Starting adm1278 update\n");
+
+		status = adm1278_read_telemetry(client, regs);
+		if (status < 0) {
+			dev_dbg(&client->dev, "telemetry, err %d\n", status);
+			data->valid = 0;
+			goto exit;
+		}
+
+		memcpy(data->regs, regs, sizeof(regs));
+		data->last_updated = jiffies;
+		data->valid = 1;
+	}
+
+exit:
+	mutex_unlock(&data->update_lock);
+	return data;
+}
+
+/* Decode a DIRECT format value to hwmon units, rsense in micro-ohm */
+static long adm1278_direct_to_hwmon(const struct adm1278_coefficient *c, u16 reg, unsigned int rsense)
+{
+	s64 val = reg;
+	s64 m = c->m;
+	int R;
+
+	for (R = c->R; R < 0; R++) {
+		val *= 10;
+	}
+
+	for (; R > 0; R--) {
+		m *= 10;
+	}
+
+	val = (val - c->b) * c->scale;
+
+	if (c->rsense) {
+		/* m is per mOhm */
+		val *= 1000;
+		m *= rsense;
+	}
+
+	return (long)div64_s64(val, m);
+}
+
+static ssize_t show_name(struct device *dev, struct device_attribute *da, char *buf)
+{
+	return sprintf(buf, "adm1278\n");
+}
+
+static ssize_t show_label(struct device *dev, struct device_attribute *da, char *buf)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+
+	return sprintf(buf, "%s\n", adm1278_coefficients[attr->index].label);
+}
+
+static ssize_t show_telemetry(struct device *dev, struct device_attribute *da, char *buf)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct adm1278_data *data = adm1278_update_device(dev);
+	long value;
+
+	mutex_lock(&data->update_lock);
+
+	if (!data->valid) {
+		mutex_unlock(&data->update_lock);
+		return -EIO;
+	}
+
+	if (adm1278_coefficients[attr->index].rsense && !data->rsense) {
+		mutex_unlock(&data->update_lock);
+		return -ENODATA;
+	}
+
+	value = adm1278_direct_to_hwmon(&adm1278_coefficients[attr->index],
+									data->regs[attr->index], data->rsense);
+	mutex_unlock(&data->update_lock);
+
+	return sprintf(buf, "%ld\n", value);
+}
+
+static ssize_t show_config(struct device *dev, struct device_attribute *da, char *buf)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct adm1278_data *data = i2c_get_clientdata(to_i2c_client(dev));
+
+	return sprintf(buf, "%u\n", (attr->index == ADM1278_UPDATE_INTERVAL) ?
+				   data->interval : data->rsense);
+}
+
+static ssize_t set_config(struct device *dev, struct device_attribute *da,
+			const char *buf, size_t count)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct adm1278_data *data = i2c_get_clientdata(to_i2c_client(dev));
+	unsigned int value;
+	int error;
+
+	error = kstrtouint(buf, 10, &value);
+	if (error) {
+		return error;
+	}
+
+	if (attr->index == ADM1278_UPDATE_INTERVAL) {
+		if (value < 100 || value > 60000) {
+			return -EINVAL;
+		}
+	}
+	else if (value < 100 || value > 100000) {
+		return -EINVAL;
+	}
+
+	mutex_lock(&data->update_lock);
+	if (attr->index == ADM1278_UPDATE_INTERVAL) {
+		data->interval = value;
+	}
+	else {
+		data->rsense = value;
+	}
+	mutex_unlock(&data->update_lock);
+
+	return count;
+}
+
+/* Switch the hot-swap controller at addr of i2c-<bus> on or off, for
+ * in-kernel protection paths which cannot wait for userspace.
+ */
+int adm1278_set_hot_swap(int bus, unsigned short addr, int enable)
+{
+    struct adm1278_data *data;
+    int ret = -ENODEV;
+
+    mutex_lock(&adm1278_clients_lock);
+
+    list_for_each_entry(data, &adm1278_clients, list) {
+        if (i2c_adapter_id(data->client->adapter) == bus && data->client->addr == addr) {
+            ret = i2c_smbus_write_byte_data(data->client, PB_OPERATION_OFFSET,
+                                            enable ? PB_OPERATION_CONTROL_ON : 0);
+            break;
+        }
+    }
+
+    mutex_unlock(&adm1278_clients_lock);
+
+    return ret;
+}
+EXPORT_SYMBOL(adm1278_set_hot_swap);
+
 static int adm1278_probe(struct i2c_client *client,
             const struct i2c_device_id *dev_id)
 {
@@ -124,6 +442,28 @@ static int adm1278_probe(struct i2c_client *client,
     }
 
     i2c_set_clientdata(client, data);
+    mutex_init(&data->update_lock);
+    data->interval = ADM1278_DEFAULT_INTERVAL;
+    data->rsense   = ADM1278_DEFAULT_RSENSE;
+
+    /* Enable VOUT and TEMP1 sampling, READ_VOUT and READ_TEMPERATURE_1
+     * return stale data otherwise.
+     */
+    status = i2c_smbus_read_word_data(client, ADM1278_PMON_CONFIG);
+    if (status < 0) {
+        dev_dbg(&client->dev, "reg 0x%x, err %d\n", ADM1278_PMON_CONFIG, status);
+        goto exit_free;
+    }
+
+    if ((status & (ADM1278_VOUT_EN | ADM1278_TEMP1_EN)) != (ADM1278_VOUT_EN | ADM1278_TEMP1_EN)) {
+        status = i2c_smbus_write_word_data(client, ADM1278_PMON_CONFIG,
+                                           status | ADM1278_VOUT_EN | ADM1278_TEMP1_EN);
+        if (status < 0) {
+            dev_dbg(&client->dev, "reg 0x%x, err %d\n", ADM1278_PMON_CONFIG, status);
+            goto exit_free;
+        }
+    }
+
     dev_info(&client->dev, "chip found\n");
 
     /* Register sysfs hooks */
@@ -141,6 +481,11 @@ static int adm1278_probe(struct i2c_client *client,
     dev_info(&client->dev, "%s: adm1278 '%s'\n",
          dev_name(data->hwmon_dev), client->name);
 
+    data->client = client;
+    mutex_lock(&adm1278_clients_lock);
+    list_add_tail(&data->list, &adm1278_clients);
+    mutex_unlock(&adm1278_clients_lock);
+
     return 0;
 
 exit_remove:
@@ -156,6 +501,10 @@ static int adm1278_remove(struct i2c_client *client)
 {
     struct adm1278_data *data = i2c_get_clientdata(client);
 
+    mutex_lock(&adm1278_clients_lock);
+    list_del(&data->list);
+    mutex_unlock(&adm1278_clients_lock);
+
     hwmon_device_unregister(data->hwmon_dev);
     sysfs_remove_group(&client->dev.kobj, &adm1278_group);
     kfree(data);
@@ -23,6 +23,8 @@
 #include <linux/err.h>
 #include <linux/leds.h>
 #include <linux/slab.h>
+#include <linux/atomic.h>
+#include <linux/wait.h>
 
 #define DRVNAME "accton_omp800_led"
 
@@ -35,8 +37,13 @@
 	#define DEBUG_PRINT(fmt, args...)
 #endif
 
-extern int omp800_cpld_read(unsigned short cpld_addr, u8 reg);
-extern int omp800_cpld_write(unsigned short cpld_addr, u8 reg, u8 value);
+extern int omp800_cpld_read_regs(unsigned short cpld_addr, const u8 *regs, u8 *values, int num);
+extern int omp800_cpld_write_async(unsigned short cpld_addr, u8 reg, u8 value,
+								   void (*complete)(void *context, int status, u8 value),
+								   void *context);
+extern int omp800_cpld_update_bits_async(unsigned short cpld_addr, u8 reg, u8 mask, u8 value,
+										 void (*complete)(void *context, int status, u8 value),
+										 void *context);
 
 enum omp800_platform {
 	OMP800_FC,
@@ -52,6 +59,8 @@ struct accton_omp800_led_data {
 	u8				reg_val[5];	  /* Register value, 0 = RELEASE/DIAG LED,
 													 1 = FAN/PSU LED,
 													 2 ~ 4 = SYSTEM LED */
+	atomic_t		pending;	  /* Writes queued on the CPLD, not completed yet */
+	wait_queue_head_t pending_wait;
 };
 
 static struct accton_omp800_led_data  *ledctl = NULL;
@@ -162,14 +171,77 @@ static u8 led_light_mode_to_reg_val(enum led_type type,
 	return reg_val;
 }
 
-static int accton_omp800_led_read_value(u8 reg)
+static int led_light_mode_to_reg_mask(enum led_type type, enum led_light_mode mode,
+									 u8 *mask, u8 *reg_val) {
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(led_type_mode_data); i++) {
+		if (type != led_type_mode_data[i].type)
+			continue;
+
+		if (mode != led_type_mode_data[i].mode)
+			continue;
+
+		*mask    = led_type_mode_data[i].type_mask;
+		*reg_val = led_light_mode_to_reg_val(type, mode, 0) & *mask;
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
+/* LED writes are queued on the CPLD so that brightness_set never sleeps,
+ * the cached registers are invalidated once the write has hit the bus.
+ */
+static void accton_omp800_led_write_done(void *context, int status, u8 value)
+{
+	if (status < 0) {
+		dev_dbg(&ledctl->pdev->dev, "reg %d, err %d\n", (int)(long)context, status);
+	}
+
+	mutex_lock(&ledctl->update_lock);
+	ledctl->valid = 0;
+	mutex_unlock(&ledctl->update_lock);
+
+	if (atomic_dec_and_test(&ledctl->pending)) {
+		wake_up(&ledctl->pending_wait);
+	}
+}
+
+static int accton_omp800_led_update_bits(u8 reg, u8 mask, u8 value)
+{
+	int status;
+
+	atomic_inc(&ledctl->pending);
+	status = omp800_cpld_update_bits_async(0x60, reg, mask, value,
+										   accton_omp800_led_write_done, (void *)(long)reg);
+	if (status < 0) {
+		atomic_dec(&ledctl->pending);
+	}
+
+	return status;
+}
+
+static int accton_omp800_led_read_values(const u8 *regs, u8 *values, int num)
 {
-	return omp800_cpld_read(0x60, reg);
+	return omp800_cpld_read_regs(0x60, regs, values, num);
 }
 
-static int accton_omp800_led_write_value(u8 reg, u8 value)
+/* Contiguous registers queued back to back go out as one block write */
+static int accton_omp800_led_write_values(u8 reg, const u8 *values, u8 len)
 {
-	return omp800_cpld_write(0x60, reg, value);
+	int i, status = 0;
+
+	for (i = 0; i < len && status >= 0; i++) {
+		atomic_inc(&ledctl->pending);
+		status = omp800_cpld_write_async(0x60, reg + i, values[i],
+										 accton_omp800_led_write_done, (void *)(long)(reg + i));
+		if (status < 0) {
+			atomic_dec(&ledctl->pending);
+		}
+	}
+
+	return status;
 }
 
 static void accton_omp800_led_update(void)
@@ -178,7 +250,7 @@ static void accton_omp800_led_update(void)
 
 	if (time_after(jiffies, ledctl->last_updated + HZ + HZ / 2)
 		|| !ledctl->valid) {
-		int i, nLedRegs;
+		int status, nLedRegs;
 
 		dev_dbg(&ledctl->pdev->dev, "Starting accton_omp800_led update\n");
 		ledctl->valid = 0;
@@ -188,15 +260,10 @@ static void accton_omp800_led_update(void)
 		 */
 		nLedRegs = ledctl->platform == OMP800_FC ? 5 : 4;
 		
-		for (i = 0; i < nLedRegs; i++) {
-			int status = accton_omp800_led_read_value(led_reg[i]);
-			
-			if (status < 0) {
-				dev_dbg(&ledctl->pdev->dev, "reg %d, err %d\n", led_reg[i], status);
-				goto exit;
-			}
-			else
-				ledctl->reg_val[i] = status;
+		status = accton_omp800_led_read_values(led_reg, ledctl->reg_val, nLedRegs);
+		if (status < 0) {
+			dev_dbg(&ledctl->pdev->dev, "led regs, err %d\n", status);
+			goto exit;
 		}
 		
 		ledctl->last_updated = jiffies;
@@ -211,22 +278,18 @@ static void accton_omp800_led_set(struct led_classdev *led_cdev,
 									  enum led_brightness led_light_mode, 
 									  u8 reg, enum led_type type)
 {
-	int reg_val;
-	
-	mutex_lock(&ledctl->update_lock);
-	reg_val = accton_omp800_led_read_value(reg);
-	
-	if (reg_val < 0) {
-		dev_dbg(&ledctl->pdev->dev, "reg %d, err %d\n", reg, reg_val);
-		goto exit;
+	int status;
+	u8 mask, reg_val;
+
+	if (led_light_mode_to_reg_mask(type, led_light_mode, &mask, &reg_val) < 0) {
+		return;
 	}
 
-	reg_val = led_light_mode_to_reg_val(type, led_light_mode, reg_val);
-	accton_omp800_led_write_value(reg, reg_val);
-	ledctl->valid = 0;
+	status = accton_omp800_led_update_bits(reg, mask, reg_val);
 	
-exit:
-	mutex_unlock(&ledctl->update_lock);
+	if (status < 0) {
+		dev_dbg(&ledctl->pdev->dev, "reg %d, err %d\n", reg, status);
+	}
 }
 
 static void accton_omp800_led_psu_set(struct led_classdev *led_cdev,
@@ -280,33 +343,26 @@ static enum led_brightness accton_omp800_led_release_get(struct led_classdev *cd
 static void accton_omp800_led_sys_set(struct led_classdev *led_cdev,
 											enum led_brightness led_light_mode)
 {
-	if (LED_MODE_OFF == (enum led_light_mode)led_light_mode) {
-		accton_omp800_led_write_value(led_reg[1], LED_BRIGHTNESS_OFF_VALUE);
-		accton_omp800_led_write_value(led_reg[2], LED_BRIGHTNESS_OFF_VALUE);
-		accton_omp800_led_write_value(led_reg[3], LED_BRIGHTNESS_OFF_VALUE);
-		return;
-	}
-	
-	if (LED_MODE_GREEN == (enum led_light_mode)led_light_mode) {
-		accton_omp800_led_write_value(led_reg[1], LED_BRIGHTNESS_OFF_VALUE);
-		accton_omp800_led_write_value(led_reg[2], LED_BRIGHTNESS_ON_VALUE);
-		accton_omp800_led_write_value(led_reg[3], LED_BRIGHTNESS_OFF_VALUE);
-		return;
-	}
-	
-	if (LED_MODE_RED == (enum led_light_mode)led_light_mode) {
-		accton_omp800_led_write_value(led_reg[1], LED_BRIGHTNESS_ON_VALUE);
-		accton_omp800_led_write_value(led_reg[2], LED_BRIGHTNESS_OFF_VALUE);
-		accton_omp800_led_write_value(led_reg[3], LED_BRIGHTNESS_OFF_VALUE);
-		return;
-	}
-	
-	if (LED_MODE_BLUE == (enum led_light_mode)led_light_mode) {
-		accton_omp800_led_write_value(led_reg[1], LED_BRIGHTNESS_OFF_VALUE);
-		accton_omp800_led_write_value(led_reg[2], LED_BRIGHTNESS_OFF_VALUE);
-		accton_omp800_led_write_value(led_reg[3], LED_BRIGHTNESS_ON_VALUE);
+	/* SYSTEM LED red/green/blue registers (0x43 ~ 0x45) are contiguous */
+	u8 values[3] = { LED_BRIGHTNESS_OFF_VALUE, LED_BRIGHTNESS_OFF_VALUE, LED_BRIGHTNESS_OFF_VALUE };
+
+	switch ((enum led_light_mode)led_light_mode) {
+	case LED_MODE_OFF:
+		break;
+	case LED_MODE_RED:
+		values[0] = LED_BRIGHTNESS_ON_VALUE;
+		break;
+	case LED_MODE_GREEN:
+		values[1] = LED_BRIGHTNESS_ON_VALUE;
+		break;
+	case LED_MODE_BLUE:
+		values[2] = LED_BRIGHTNESS_ON_VALUE;
+		break;
+	default:
 		return;
 	}
+
+	accton_omp800_led_write_values(led_reg[1], values, ARRAY_SIZE(values));
 }
 
 static enum led_brightness accton_omp800_led_sys_get(struct led_classdev *cdev)
@@ -407,6 +463,11 @@ static int accton_omp800_led_remove(struct platform_device *pdev)
 		led_classdev_unregister(&accton_omp800_leds[i]);
 	}
 
+	/* Unregistering turns the LEDs off, the completions log through
+	 * pdev->dev so wait for them while it is still around.
+	 */
+	wait_event(ledctl->pending_wait, !atomic_read(&ledctl->pending));
+
 	return 0;
 }
 
@@ -459,6 +520,8 @@ static int __init accton_omp800_led_init(void)
 	ledctl->platform = OMP800_FC;
 #endif
 	mutex_init(&ledctl->update_lock);
+	atomic_set(&ledctl->pending, 0);
+	init_waitqueue_head(&ledctl->pending_wait);
 
 	ledctl->pdev = platform_device_register_simple(DRVNAME, -1, NULL, 0);
 	if (IS_ERR(ledctl->pdev)) {
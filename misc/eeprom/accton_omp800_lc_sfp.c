@@ -75,6 +75,7 @@ static ssize_t sfp_show_ddm_implemented(struct device *dev, struct device_attrib
 static ssize_t sfp_eeprom_read(struct i2c_client *, u8, u8 *,int);
 static ssize_t sfp_eeprom_write(struct i2c_client *, u8 , const char *,int);
 extern int omp800_cpld_read(unsigned short cpld_addr, u8 reg);
+extern int omp800_cpld_read_block(unsigned short cpld_addr, u8 reg, u8 len, u8 *values);
 
 enum sfp_sysfs_attributes {
 	PRESENT,
@@ -307,24 +308,22 @@ static struct sfp_port_data *sfp_update_present(struct i2c_client *client)
 	struct sfp_port_data *data = i2c_get_clientdata(client);
 	int i = 0;
 	int status = -1;
-	u8 regs[] = {0x30, 0x31};
+	u8 values[2] = {0};
 
 	DEBUG_PRINT("Starting sfp present status update");
 	mutex_lock(&data->update_lock);
 
-	/* Read present status of port 1~16 */
+	/* Read present status of port 1~16 (reg 0x30 ~ 0x31) */
 	data->present = 0;
-	
-	for (i = 0; i < ARRAY_SIZE(regs); i++) {
-		status = omp800_cpld_read(0x62, regs[i]);
-		
-		if (status < 0) {
-			DEBUG_PRINT("cpld(0x62) reg(0x%x) err %d", regs[i], status);
-			goto exit;
-		}
-		
-		DEBUG_PRINT("Present status = 0x%lx", data->present);		
-		data->present |= (u32)status << (i*8);
+
+	status = omp800_cpld_read_block(0x62, 0x30, ARRAY_SIZE(values), values);
+	if (status < 0) {
+		DEBUG_PRINT("cpld(0x62) reg(0x30) err %d", status);
+		goto exit;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(values); i++) {
+		data->present |= (u32)values[i] << (i*8);
 	}
 
 	DEBUG_PRINT("Present status = 0x%lx", data->present);